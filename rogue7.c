@@ -1,10 +1,17 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <time.h>
 #include <string.h>
 #include <curses.h>   // or <ncurses.h> depending on your platform
 #include <unistd.h>   // for usleep() if you want a small delay
 #include <locale.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /*
  * ------------------------------------------------------------
@@ -12,25 +19,94 @@
  * ------------------------------------------------------------
  */
 
-#define SIZE 3           // The 3x3 “macro” dungeon layout
-#define BIG_SIZE 30      // The 30x30 “tiled” map dimensions
-#define SUBGRID_SIZE 10  // Each 3x3 cell corresponds to a 10x10 subgrid
+#define DEFAULT_GRID_SIZE 3      // The default 3x3 “macro” dungeon layout
+#define DEFAULT_SUBGRID_SIZE 10  // Each macro cell corresponds to a 10x10 subgrid
 #define MIN_ROOM_DIM 5
 #define MAX_ROOM_DIM 9
+#define MIN_SUBGRID_SIZE (MIN_ROOM_DIM + 2) // room plus a 1-tile margin each side
+#define MAX_SUBGRID_SIZE 64
+#define MAX_GRID_SIZE 256
+
+// Size of the static buffer main() hands to dungeonInit(); enough for two
+// 256x256 macro grids at the default subgrid size plus a flow field and
+// path finding scratch, or for one smaller level per worker thread in
+// batch generation.
+#define DUNGEON_ARENA_BYTES (256u * 1024u * 1024u)
+#define MAX_THREADS 64
 
-int playerX, playerY;       // player's position in bigMap
 int hasTreasure = 0;        // 0 = not yet, 1 = got treasure
 int gameRunning = 1;        // 1 = running, 0 = user quit or reached exit
+int currentDepth = 1;       // level the player is on, 1 = the first
+long turnCount = 0;         // turns played: moves, attacks and travel steps
 
-// These store which 3x3 cells actually have rooms (1) and which corridors connect them
-int rooms[SIZE][SIZE] = {0};
-int horizontal_corridors[SIZE][SIZE] = {0};
-int vertical_corridors[SIZE][SIZE]   = {0};
-
-int dist[SIZE][SIZE]; // store BFS distances
+/*
+ * Tile IDs stored in bigMap. Each cell is a single byte; the UTF-8 glyph for a
+ * tile is only looked up (via tileGlyphs[]) when rendering.
+ */
+typedef enum {
+    TILE_BLANK = 0,     // " "
+    TILE_FLOOR,         // "."
+    TILE_WALL_H,        // "─"
+    TILE_WALL_V,        // "│"
+    TILE_CORNER_TL,     // "┌"
+    TILE_CORNER_TR,     // "┐"
+    TILE_CORNER_BL,     // "└"
+    TILE_CORNER_BR,     // "┘"
+    TILE_DOOR,          // "╬"
+    TILE_CORRIDOR,      // "▒"
+    TILE_PLAYER,        // "@"
+    TILE_TREASURE,      // "T"
+    TILE_EXIT,          // "E"
+    TILE_MONSTER,       // "M" (drawn over the map, never stored in it)
+    TILE_COUNT
+} Tile;
+
+static const char *tileGlyphs[TILE_COUNT] = {
+    [TILE_BLANK]     = " ",
+    [TILE_FLOOR]     = ".",
+    [TILE_WALL_H]    = "─",
+    [TILE_WALL_V]    = "│",
+    [TILE_CORNER_TL] = "┌",
+    [TILE_CORNER_TR] = "┐",
+    [TILE_CORNER_BL] = "└",
+    [TILE_CORNER_BR] = "┘",
+    [TILE_DOOR]      = "╬",
+    [TILE_CORRIDOR]  = "▒",
+    [TILE_PLAYER]    = "@",
+    [TILE_TREASURE]  = "T",
+    [TILE_EXIT]      = "E",
+    [TILE_MONSTER]   = "M",
+};
 
-// The big 30x30 tile map; each cell is a short string for box-drawing or filler
-char bigMap[BIG_SIZE][BIG_SIZE][4];
+/*
+ * Per-tile property flags. Each Dungeon keeps one byte of these per map
+ * cell (see computeTileProps), so movement and sight checks are a single
+ * mask test instead of comparing tile IDs.
+ */
+enum {
+    PROP_WALKABLE     = 1 << 0,
+    PROP_DOOR         = 1 << 1,
+    PROP_CORRIDOR     = 1 << 2,
+    PROP_ROOM         = 1 << 3,   // room interior (floor and what stands on it)
+    PROP_BLOCKS_SIGHT = 1 << 4,
+};
+
+// TILE_PLAYER and TILE_MONSTER have no entry: they are overlays, and
+// writing the player keeps the properties of the tile underneath.
+static const unsigned char tileProps[TILE_COUNT] = {
+    [TILE_BLANK]     = PROP_BLOCKS_SIGHT,
+    [TILE_FLOOR]     = PROP_WALKABLE | PROP_ROOM,
+    [TILE_WALL_H]    = PROP_BLOCKS_SIGHT,
+    [TILE_WALL_V]    = PROP_BLOCKS_SIGHT,
+    [TILE_CORNER_TL] = PROP_BLOCKS_SIGHT,
+    [TILE_CORNER_TR] = PROP_BLOCKS_SIGHT,
+    [TILE_CORNER_BL] = PROP_BLOCKS_SIGHT,
+    [TILE_CORNER_BR] = PROP_BLOCKS_SIGHT,
+    [TILE_DOOR]      = PROP_WALKABLE | PROP_DOOR,
+    [TILE_CORRIDOR]  = PROP_WALKABLE | PROP_CORRIDOR,
+    [TILE_TREASURE]  = PROP_WALKABLE | PROP_ROOM,
+    [TILE_EXIT]      = PROP_WALKABLE | PROP_ROOM,
+};
 
 /*
  * A TiledRoom describes a room's position in the bigMap plus its width, height, and existence.
@@ -41,8 +117,129 @@ typedef struct {
     int exists;     // 1 if there is a room, 0 if none
 } TiledRoom;
 
-// Store 3x3 of these TiledRooms, paralleling the rooms[][] array
-TiledRoom tiledRooms[SIZE][SIZE];
+/*
+ * Rng: PCG32 generator state. Each Dungeon carries its own, so a level is
+ * a pure function of its seed and dimensions.
+ */
+typedef struct {
+    uint64_t state;
+    uint64_t inc;
+} Rng;
+
+/*
+ * The stages of generateLevel(), in pipeline order.
+ */
+typedef enum {
+    STAGE_GENERATE_MAZE,
+    STAGE_BUILD_GRAPH,
+    STAGE_REMOVE_ROOMS,
+    STAGE_CLEAR_MAP,
+    STAGE_POSITION_ROOMS,
+    STAGE_DRAW_ROOMS,
+    STAGE_DRAW_JUNCTIONS,
+    STAGE_CONNECT_NODES,
+    STAGE_PLACE_DOORS,
+    STAGE_PLACE_PLAYER,
+    STAGE_PLACE_TREASURE,
+    STAGE_PLACE_EXIT,
+    STAGE_TILE_PROPS,
+    STAGE_COUNT
+} GenStage;
+
+static const char *genStageNames[STAGE_COUNT] = {
+    [STAGE_GENERATE_MAZE]  = "generateMaze",
+    [STAGE_BUILD_GRAPH]    = "buildMacroGraph",
+    [STAGE_REMOVE_ROOMS]   = "removeSomeRooms",
+    [STAGE_CLEAR_MAP]      = "clearBigMap",
+    [STAGE_POSITION_ROOMS] = "positionRoomsInQuadrants",
+    [STAGE_DRAW_ROOMS]     = "drawAllRooms",
+    [STAGE_DRAW_JUNCTIONS] = "drawMissingRoomJunctions",
+    [STAGE_CONNECT_NODES]  = "connectNodesWithCorridors",
+    [STAGE_PLACE_DOORS]    = "placeDoorsForCorridors",
+    [STAGE_PLACE_PLAYER]   = "placePlayerInEdgeRoom",
+    [STAGE_PLACE_TREASURE] = "placeTreasureInRandomRoom",
+    [STAGE_PLACE_EXIT]     = "placeExitFarthestFromPlayer",
+    [STAGE_TILE_PROPS]     = "computeTileProps",
+};
+
+/*
+ * GenStats: instrumentation accumulated over every level a Dungeon
+ * generates. Counters are always kept; stage timings only when
+ * Dungeon.timeStages is set, since reading the clock costs more than
+ * some of the stages on small maps.
+ */
+typedef struct {
+    uint64_t levels;                // levels generated
+    uint64_t stageNs[STAGE_COUNT];  // total nanoseconds per stage
+    uint64_t cellsWritten;          // tiles written via setCell()
+    uint64_t corridorTiles;         // tiles carved by carveCorridor()
+    uint64_t roomsRemoved;          // rooms turned into junctions by removeSomeRooms()
+    uint64_t walkableTiles;         // walkable cells in the finished levels
+} GenStats;
+
+/*
+ * One entry of the explicit stack used by iterativeBacktracking().
+ */
+typedef struct {
+    int x, y;       // macro cell being explored
+    int dirs[4];    // shuffled direction order
+    int next;       // index of the next direction to try
+} DfsFrame;
+
+/*
+ * A Dungeon holds one level: the gridW x gridH macro layout and the tiled
+ * map built from it. The dimensions are picked at startup; every array
+ * points into a caller-provided buffer (see dungeonInit), so nothing is
+ * allocated dynamically.
+ */
+typedef struct {
+    Rng rng;                // generator state, seeded by generateLevel()
+    uint64_t seed;          // seed the current level was generated from
+
+    int gridW, gridH;       // macro grid dimensions (cells)
+    int subgridSize;        // each macro cell covers subgridSize x subgridSize tiles
+    int bigW, bigH;         // tiled map dimensions
+
+    // Which macro cells actually have rooms (1) and which corridors connect them
+    unsigned char *rooms;
+    unsigned char *horizontal_corridors;
+    unsigned char *vertical_corridors;
+
+    // The macro graph in CSR form, built once per level by buildMacroGraph():
+    // the neighbours of cell c are graphAdj[graphStart[c] .. graphStart[c+1]-1]
+    int *graphStart;        // one entry per cell, plus one
+    int *graphAdj;          // at most four neighbours per cell
+    unsigned char *graphFlags; // MACRO_ROOM / MACRO_NODE per cell
+
+    int *dist;              // BFS distances per macro cell
+    int *queue;             // scratch: BFS queue / candidate lists (one slot per cell)
+    DfsFrame *dfsStack;     // scratch: maze generation stack (one frame per cell)
+
+    TiledRoom *tiledRooms;  // paralleling the rooms array
+    unsigned char *bigMap;  // the tiled map; one Tile ID per cell
+    unsigned char *props;   // PROP_* flags per map cell, kept in sync by setCell()
+    uint64_t *walkBits;     // PROP_WALKABLE packed 64 cells per word, walkWords per row
+    int walkWords;
+
+    int playerX, playerY;   // player's position in bigMap
+    int treasureX, treasureY; // treasure position, -1 if the level has none
+    int exitX, exitY;       // exit position, -1 if the level has none
+
+    int keepEdgeGap;        // 1 = rooms never touch the east/south map edge (world chunks)
+    int timeStages;         // 1 = record per-stage timings in stats
+    GenStats stats;
+} Dungeon;
+
+// Row-major accessors for the flat arrays above
+#define ROOM(d, gx, gy)  ((d)->rooms[(gy) * (d)->gridW + (gx)])
+#define HCORR(d, gx, gy) ((d)->horizontal_corridors[(gy) * (d)->gridW + (gx)])
+#define VCORR(d, gx, gy) ((d)->vertical_corridors[(gy) * (d)->gridW + (gx)])
+#define DIST(d, gx, gy)  ((d)->dist[(gy) * (d)->gridW + (gx)])
+#define DEGREE(d, c)     ((d)->graphStart[(c) + 1] - (d)->graphStart[c])
+#define TROOM(d, gx, gy) ((d)->tiledRooms[(gy) * (d)->gridW + (gx)])
+#define TILE(d, x, y)    ((d)->bigMap[(size_t)(y) * (d)->bigW + (x)])
+#define PROPS(d, x, y)   ((d)->props[(size_t)(y) * (d)->bigW + (x)])
+#define WALK_WORD(d, x, y) ((d)->walkBits[(size_t)(y) * (d)->walkWords + ((x) >> 6)])
 
 /*
  * ------------------------------------------------------------
@@ -50,15 +247,63 @@ TiledRoom tiledRooms[SIZE][SIZE];
  * ------------------------------------------------------------
  */
 
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * rngNext: Returns the next 32 random bits from a PCG32 (XSH RR) generator.
+ */
+static uint32_t rngNext(Rng *r)
+{
+    uint64_t old = r->state;
+    r->state = old * 6364136223846793005ULL + r->inc;
+    uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = (uint32_t)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+/**
+ * rngSeed: Resets the generator so it produces the stream for `seed`.
+ */
+static void rngSeed(Rng *r, uint64_t seed)
+{
+    r->state = 0;
+    r->inc   = (0xda3e39cb94b95bdbULL << 1u) | 1u;
+    rngNext(r);
+    r->state += seed;
+    rngNext(r);
+}
+
+/**
+ * rngRange: Returns a random int in [0, n). Uses a multiply-shift instead
+ * of a modulo, so it costs one multiply and always consumes one draw.
+ */
+static int rngRange(Rng *r, int n)
+{
+    return (int)(((uint64_t)rngNext(r) * (uint32_t)n) >> 32);
+}
+
 /**
  * shuffle: Fisher–Yates shuffle for an int array
+ * @param rng   The generator to draw from
  * @param array The array to shuffle
  * @param n     Number of elements
  */
-static void shuffle(int *array, size_t n)
+static void shuffle(Rng *rng, int *array, size_t n)
 {
     for (size_t i = 0; i < n - 1; i++) {
-        size_t j = i + rand() / (RAND_MAX / (n - i) + 1);
+        size_t j = i + (size_t)rngRange(rng, (int)(n - i));
         int t = array[j];
         array[j] = array[i];
         array[i] = t;
@@ -66,18 +311,192 @@ static void shuffle(int *array, size_t n)
 }
 
 /**
- * setCell: Safely place up to 3 characters plus a null terminator
- * into the bigMap cell at (x,y).
+ * setCell: Store a Tile ID into the bigMap cell at (x,y), updating the
+ * cell's property flags and walkable bit to match.
+ */
+static void setCell(Dungeon *d, int x, int y, unsigned char tile)
+{
+    TILE(d, x, y) = tile;
+    d->stats.cellsWritten++;
+
+    if (tile == TILE_PLAYER) return;
+
+    unsigned char p = tileProps[tile];
+    uint64_t bit = 1ULL << (x & 63);
+    PROPS(d, x, y) = p;
+    if (p & PROP_WALKABLE) {
+        WALK_WORD(d, x, y) |= bit;
+    } else {
+        WALK_WORD(d, x, y) &= ~bit;
+    }
+}
+
+/**
+ * setRowSpan: setCell() on the `len` cells from (x,y) eastwards, with the
+ * tiles and props stored by memset and the walkable bits a word at a time.
+ */
+static void setRowSpan(Dungeon *d, int x, int y, int len, unsigned char tile)
+{
+    memset(&TILE(d, x, y), tile, (size_t)len);
+    d->stats.cellsWritten += (uint64_t)len;
+
+    if (tile == TILE_PLAYER) return;
+
+    unsigned char p = tileProps[tile];
+    memset(&PROPS(d, x, y), p, (size_t)len);
+    for (int end = x + len; x < end; ) {
+        int lo = x & 63;
+        int n = 64 - lo;
+        if (n > end - x) n = end - x;
+        uint64_t mask = (n == 64 ? ~0ULL : (1ULL << n) - 1) << lo;
+        if (p & PROP_WALKABLE) {
+            WALK_WORD(d, x, y) |= mask;
+        } else {
+            WALK_WORD(d, x, y) &= ~mask;
+        }
+        x += n;
+    }
+}
+
+/**
+ * setColumnSpan: setCell() on the `len` cells from (x,y) southwards, with
+ * the props and walkable bit worked out once and written down each plane
+ * at its row stride.
+ */
+static void setColumnSpan(Dungeon *d, int x, int y, int len, unsigned char tile)
+{
+    unsigned char *t = &TILE(d, x, y);
+    for (int i = 0; i < len; i++) t[(size_t)i * d->bigW] = tile;
+    d->stats.cellsWritten += (uint64_t)len;
+
+    if (tile == TILE_PLAYER) return;
+
+    unsigned char p = tileProps[tile];
+    uint64_t bit = 1ULL << (x & 63);
+    uint64_t set = (p & PROP_WALKABLE) ? bit : 0;
+    unsigned char *pr = &PROPS(d, x, y);
+    uint64_t *w = &WALK_WORD(d, x, y);
+    for (int i = 0; i < len; i++) {
+        pr[(size_t)i * d->bigW] = p;
+        w[(size_t)i * d->walkWords] = (w[(size_t)i * d->walkWords] & ~bit) | set;
+    }
+}
+
+/**
+ * fillTileRect: Stores `tile` into the w x h rectangle at (x,y), one
+ * memset per row. Writes the tile plane only; computeTileProps() derives
+ * the props once the map is finished.
+ */
+static void fillTileRect(Dungeon *d, int x, int y, int w, int h, unsigned char tile)
+{
+    if (w <= 0) return;
+    for (int end = y + h; y < end; y++) {
+        memset(&TILE(d, x, y), tile, (size_t)w);
+    }
+}
+
+/**
+ * isWalkable: 1 if the player (or anything else) may stand on (x,y).
+ */
+static int isWalkable(const Dungeon *d, int x, int y)
+{
+    return (PROPS(d, x, y) & PROP_WALKABLE) != 0;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Dungeon Storage
+ * ------------------------------------------------------------
+ */
+
+/**
+ * arenaTake: Carves `bytes` (rounded up to 8) off the front of a buffer.
+ * Returns NULL if the buffer is exhausted.
+ */
+static void *arenaTake(unsigned char **cursor, size_t *left, size_t bytes)
+{
+    bytes = (bytes + 7) & ~(size_t)7;
+    if (bytes > *left) return NULL;
+    void *p = *cursor;
+    *cursor += bytes;
+    *left   -= bytes;
+    return p;
+}
+
+/**
+ * dungeonBytesNeeded: How large a buffer dungeonInit() needs for a
+ * gridW x gridH macro grid with the given subgrid size.
+ */
+size_t dungeonBytesNeeded(int gridW, int gridH, int subgridSize)
+{
+    size_t cells = (size_t)gridW * gridH;
+    size_t tiles = cells * subgridSize * subgridSize;
+    size_t total = 0;
+
+    total += 3 * ((cells + 7) & ~(size_t)7);                  // rooms + corridors
+    total += (((cells + 1) * sizeof(int) + 7) & ~(size_t)7)   // graphStart
+           + ((4 * cells * sizeof(int) + 7) & ~(size_t)7)     // graphAdj
+           + ((cells + 7) & ~(size_t)7);                      // graphFlags
+    total += 2 * ((cells * sizeof(int) + 7) & ~(size_t)7);    // dist + queue
+    total += (cells * sizeof(DfsFrame) + 7) & ~(size_t)7;     // dfsStack
+    total += (cells * sizeof(TiledRoom) + 7) & ~(size_t)7;    // tiledRooms
+    total += 2 * ((tiles + 7) & ~(size_t)7);                  // bigMap + props
+    total += (size_t)gridH * subgridSize                      // walkBits
+           * ((gridW * subgridSize + 63) / 64) * sizeof(uint64_t);
+    return total;
+}
+
+/**
+ * dungeonInit: Sets the dimensions of a Dungeon and points all of its
+ * arrays into `buffer`.
+ * @return 0 on success, -1 if the dimensions are out of range or the
+ *         buffer is too small.
  */
-static void setCell(int x, int y, const char *s)
+int dungeonInit(Dungeon *d, int gridW, int gridH, int subgridSize,
+                void *buffer, size_t bufferSize)
 {
-    strncpy(bigMap[y][x], s, 3);
-    bigMap[y][x][3] = '\0';
+    if (gridW < 1 || gridW > MAX_GRID_SIZE || gridH < 1 || gridH > MAX_GRID_SIZE)
+        return -1;
+    if (subgridSize < MIN_SUBGRID_SIZE || subgridSize > MAX_SUBGRID_SIZE)
+        return -1;
+    if (dungeonBytesNeeded(gridW, gridH, subgridSize) > bufferSize)
+        return -1;
+
+    size_t cells = (size_t)gridW * gridH;
+    unsigned char *cursor = buffer;
+    size_t left = bufferSize;
+
+    d->gridW       = gridW;
+    d->gridH       = gridH;
+    d->subgridSize = subgridSize;
+    d->bigW        = gridW * subgridSize;
+    d->bigH        = gridH * subgridSize;
+
+    d->rooms                = arenaTake(&cursor, &left, cells);
+    d->horizontal_corridors = arenaTake(&cursor, &left, cells);
+    d->vertical_corridors   = arenaTake(&cursor, &left, cells);
+    d->graphStart           = arenaTake(&cursor, &left, (cells + 1) * sizeof(int));
+    d->graphAdj             = arenaTake(&cursor, &left, 4 * cells * sizeof(int));
+    d->graphFlags           = arenaTake(&cursor, &left, cells);
+    d->dist                 = arenaTake(&cursor, &left, cells * sizeof(int));
+    d->queue                = arenaTake(&cursor, &left, cells * sizeof(int));
+    d->dfsStack             = arenaTake(&cursor, &left, cells * sizeof(DfsFrame));
+    d->tiledRooms           = arenaTake(&cursor, &left, cells * sizeof(TiledRoom));
+    d->bigMap               = arenaTake(&cursor, &left, (size_t)d->bigW * d->bigH);
+    d->props                = arenaTake(&cursor, &left, (size_t)d->bigW * d->bigH);
+    d->walkWords            = (d->bigW + 63) / 64;
+    d->walkBits             = arenaTake(&cursor, &left, (size_t)d->bigH * d->walkWords
+                                                        * sizeof(uint64_t));
+
+    d->keepEdgeGap = 0;
+    d->timeStages = 0;
+    memset(&d->stats, 0, sizeof(d->stats));
+    return 0;
 }
 
 /*
  * ------------------------------------------------------------
- * Maze Generation (3x3 macro layout)
+ * Maze Generation (macro layout)
  * ------------------------------------------------------------
  */
 
@@ -85,49 +504,75 @@ static void setCell(int x, int y, const char *s)
  * markCorridorBetween: Sets the appropriate horizontal/vertical corridor flags
  * for adjacency between (x,y) and (nx,ny).
  */
-static void markCorridorBetween(int x, int y, int nx, int ny)
+static void markCorridorBetween(Dungeon *d, int x, int y, int nx, int ny)
 {
     // If we are moving vertically
     if (nx == x) {
         // If ny > y => going down; else going up
         if (ny > y) {
-            vertical_corridors[y][x] = 1;
+            VCORR(d, x, y) = 1;
         } else {
-            vertical_corridors[ny][x] = 1; 
+            VCORR(d, x, ny) = 1; 
         }
     }
     // Otherwise, we are moving horizontally
     else if (ny == y) {
         // If nx > x => going right; else going left
         if (nx > x) {
-            horizontal_corridors[y][x] = 1;
+            HCORR(d, x, y) = 1;
         } else {
-            horizontal_corridors[y][nx] = 1;
+            HCORR(d, nx, y) = 1;
         }
     }
 }
 
 /**
- * recursiveBacktracking: DFS to fill the 3x3 grid with up to max_rooms rooms.
- * Starts from (x,y). Randomly picks directions to explore, sets corridor flags,
- * and recurses.
+ * dfsVisit: Marks (x,y) as a room and pushes it onto the explicit DFS
+ * stack with a freshly shuffled direction order.
  */
-static void recursiveBacktracking(int x, int y, int *room_count, int max_rooms)
+static void dfsVisit(Dungeon *d, int *top, int x, int y, int *room_count)
 {
-    if (*room_count >= max_rooms) return;
-
     // Mark the current cell as a room
-    rooms[y][x] = 1;
+    ROOM(d, x, y) = 1;
     (*room_count)++;
 
+    DfsFrame *f = &d->dfsStack[(*top)++];
+    f->x = x;
+    f->y = y;
+    f->next = 0;
+
     // Shuffle directions [0=up,1=right,2=down,3=left]
-    int directions[] = {0, 1, 2, 3};
-    shuffle(directions, 4);
+    for (int i = 0; i < 4; i++) f->dirs[i] = i;
+    shuffle(&d->rng, f->dirs, 4);
+}
+
+/**
+ * iterativeBacktracking: DFS to fill the macro grid with up to max_rooms rooms.
+ * Starts from (x,y). Randomly picks directions to explore and sets corridor
+ * flags. Uses an explicit stack (one frame per macro cell at most) instead
+ * of recursion, so stack use and cost stay bounded on large grids; it makes
+ * the same random draws in the same order as the recursive version did, so
+ * layouts are identical for the same seed.
+ */
+static void iterativeBacktracking(Dungeon *d, int x, int y, int *room_count, int max_rooms)
+{
+    if (*room_count >= max_rooms) return;
 
-    // Explore each direction in shuffled order
-    for (int i = 0; i < 4; i++) {
-        int nx = x, ny = y;
-        switch (directions[i]) {
+    int top = 0;
+    dfsVisit(d, &top, x, y, room_count);
+
+    while (top > 0 && *room_count < max_rooms) {
+        DfsFrame *f = &d->dfsStack[top - 1];
+
+        // All four directions explored => backtrack
+        if (f->next == 4) {
+            top--;
+            continue;
+        }
+
+        // Explore the next direction in shuffled order
+        int nx = f->x, ny = f->y;
+        switch (f->dirs[f->next++]) {
             case 0: ny--; break; // up
             case 1: nx++; break; // right
             case 2: ny++; break; // down
@@ -135,52 +580,89 @@ static void recursiveBacktracking(int x, int y, int *room_count, int max_rooms)
         }
 
         // Check bounds
-        if (nx < 0 || nx >= SIZE || ny < 0 || ny >= SIZE) 
+        if (nx < 0 || nx >= d->gridW || ny < 0 || ny >= d->gridH) 
             continue;
 
         // If already a room, skip
-        if (rooms[ny][nx]) 
+        if (ROOM(d, nx, ny)) 
             continue;
 
         // Mark the corridor in the appropriate array
-        markCorridorBetween(x, y, nx, ny);
+        markCorridorBetween(d, f->x, f->y, nx, ny);
 
-        // Recurse to create a room in that direction
-        recursiveBacktracking(nx, ny, room_count, max_rooms);
-        if (*room_count >= max_rooms) 
-            return;
+        // Descend to create a room in that direction
+        dfsVisit(d, &top, nx, ny, room_count);
     }
 }
 
 /**
  * generateMaze: Picks a random start cell and a random number (6-9) of total rooms,
- * then calls recursiveBacktracking() to fill in the 3x3 grid.
+ * then calls iterativeBacktracking() to fill in the macro grid.
  */
-void generateMaze()
+void generateMaze(Dungeon *d)
 {
-    srand((unsigned)time(NULL)); // seed for reproducibility
+    size_t cells = (size_t)d->gridW * d->gridH;
+    memset(d->rooms, 0, cells);
+    memset(d->horizontal_corridors, 0, cells);
+    memset(d->vertical_corridors, 0, cells);
+
     int room_count = 0;
-    int max_rooms = 9;
+    int max_rooms = (int)cells;
     // printf("Generating up to %d rooms...\n", max_rooms);
-    int startX    = rand() % SIZE;
-    int startY    = rand() % SIZE;
+    int startX    = rngRange(&d->rng, d->gridW);
+    int startY    = rngRange(&d->rng, d->gridH);
+
+    iterativeBacktracking(d, startX, startY, &room_count, max_rooms);
+}
+
+// graphFlags bits
+enum {
+    MACRO_ROOM = 1 << 0,    // the cell has a room
+    MACRO_NODE = 1 << 1,    // no room, but corridors pass through (a junction)
+};
 
-    recursiveBacktracking(startX, startY, &room_count, max_rooms);
+/**
+ * buildMacroGraph: Turns the corridor flags into the CSR macro graph that
+ * every later stage walks instead of re-deriving adjacency from
+ * horizontal_corridors / vertical_corridors. Each cell's neighbours are
+ * listed east, west, south, north (the order the tiled map is carved in).
+ * Corridors never change after the maze is generated, only rooms (see
+ * removeSomeRooms(), which keeps graphFlags in step).
+ */
+void buildMacroGraph(Dungeon *d)
+{
+    int w = d->gridW, h = d->gridH;
+    int n = 0;
+
+    for (int gy = 0; gy < h; gy++) {
+        for (int gx = 0; gx < w; gx++) {
+            int c = gy * w + gx;
+            d->graphStart[c] = n;
+            if (gx < w - 1 && HCORR(d, gx, gy))     d->graphAdj[n++] = c + 1;
+            if (gx > 0     && HCORR(d, gx - 1, gy)) d->graphAdj[n++] = c - 1;
+            if (gy < h - 1 && VCORR(d, gx, gy))     d->graphAdj[n++] = c + w;
+            if (gy > 0     && VCORR(d, gx, gy - 1)) d->graphAdj[n++] = c - w;
+
+            d->graphFlags[c] = ROOM(d, gx, gy) ? MACRO_ROOM
+                             : (n > d->graphStart[c] ? MACRO_NODE : 0);
+        }
+    }
+    d->graphStart[w * h] = n;
 }
 
 /**
- * printMaze: (Optional) debug print for the 3x3 macro grid with corridors.
+ * printMaze: (Optional) debug print for the macro grid with corridors.
  * Shows 'R' for a room, '#' for no room, and draws '---' / '|' for corridors.
  */
-void printMaze()
+void printMaze(const Dungeon *d)
 {
-    for (int y = 0; y < SIZE; y++) {
+    for (int y = 0; y < d->gridH; y++) {
         // Top row: rooms plus horizontal corridors
-        for (int x = 0; x < SIZE; x++) {
-            printf("%c", rooms[y][x] ? 'R' : '#');
+        for (int x = 0; x < d->gridW; x++) {
+            printf("%c", ROOM(d, x, y) ? 'R' : '#');
 
-            if (x < SIZE - 1) {
-                if (horizontal_corridors[y][x] && rooms[y][x] && rooms[y][x + 1]) {
+            if (x < d->gridW - 1) {
+                if (HCORR(d, x, y) && ROOM(d, x, y) && ROOM(d, x + 1, y)) {
                     printf("---");
                 } else {
                     printf("###");
@@ -190,9 +672,9 @@ void printMaze()
         printf("\n");
 
         // Second row: vertical corridors
-        if (y < SIZE - 1) {
-            for (int x = 0; x < SIZE; x++) {
-                if (vertical_corridors[y][x] && rooms[y][x] && rooms[y+1][x]) {
+        if (y < d->gridH - 1) {
+            for (int x = 0; x < d->gridW; x++) {
+                if (VCORR(d, x, y) && ROOM(d, x, y) && ROOM(d, x, y+1)) {
                     printf("|   ");
                 } else {
                     printf("#   ");
@@ -205,46 +687,69 @@ void printMaze()
 
 /*
  * ------------------------------------------------------------
- * 30x30 Tiled Map Construction
+ * Tiled Map Construction
  * ------------------------------------------------------------
  */
 
 /**
- * clearBigMap: Fills the entire 30x30 bigMap with a single blank space.
+ * clearBigMap: Fills the entire bigMap with blank tiles.
+ */
+void clearBigMap(Dungeon *d)
+{
+    // Rows are stored back to back, so the whole map is one memset
+    memset(d->bigMap, TILE_BLANK, (size_t)d->bigW * d->bigH);
+}
+
+/**
+ * clearBigMapCells: clearBigMap() one cell at a time, as it was before the
+ * span fills; kept as a pass (--passes clearBigMapCells) to compare against.
  */
-void clearBigMap()
+void clearBigMapCells(Dungeon *d)
 {
-    for (int y = 0; y < BIG_SIZE; y++) {
-        for (int x = 0; x < BIG_SIZE; x++) {
-            strncpy(bigMap[y][x], " ", 4);
+    for (int y = 0; y < d->bigH; y++) {
+        for (int x = 0; x < d->bigW; x++) {
+            TILE(d, x, y) = TILE_BLANK;
         }
     }
 }
 
 /**
  * createTiledRoom: Helper to fill a TiledRoom struct with random size and position
- * within its 10x10 subgrid, leaving a 1-tile margin. 
+ * within its subgrid, leaving a 1-tile margin. 
  */
-static void createTiledRoom(TiledRoom *r, int gx, int gy)
+static void createTiledRoom(Dungeon *d, TiledRoom *r, int gx, int gy)
 {
     r->exists = 1;
 
-    // Pick random width/height within [MIN_ROOM_DIM, MAX_ROOM_DIM]
-    int w = MIN_ROOM_DIM + rand() % (MAX_ROOM_DIM - MIN_ROOM_DIM + 1);
-    int h = MIN_ROOM_DIM + rand() % (MAX_ROOM_DIM - MIN_ROOM_DIM + 1);
-
     int margin = 1;
-    int quadX  = gx * SUBGRID_SIZE;
-    int quadY  = gy * SUBGRID_SIZE;
 
-    int availableW = SUBGRID_SIZE - w - 2 * margin;
-    int availableH = SUBGRID_SIZE - h - 2 * margin;
+    // Pick random width/height within [MIN_ROOM_DIM, maxDim]; small subgrids
+    // cap the room so it still fits after the leading margin
+    int maxDim = MAX_ROOM_DIM;
+    if (maxDim > d->subgridSize - margin) maxDim = d->subgridSize - margin;
+    int maxW = maxDim, maxH = maxDim;
+
+    // World chunks also keep a trailing margin along the east/south map
+    // edges, so border corridors always have a tile to run along
+    if (d->keepEdgeGap) {
+        int gapDim = d->subgridSize - 2 * margin;
+        if (gx == d->gridW - 1 && maxW > gapDim) maxW = gapDim;
+        if (gy == d->gridH - 1 && maxH > gapDim) maxH = gapDim;
+    }
+    int w = MIN_ROOM_DIM + rngRange(&d->rng, maxW - MIN_ROOM_DIM + 1);
+    int h = MIN_ROOM_DIM + rngRange(&d->rng, maxH - MIN_ROOM_DIM + 1);
+
+    int quadX  = gx * d->subgridSize;
+    int quadY  = gy * d->subgridSize;
+
+    int availableW = d->subgridSize - w - 2 * margin;
+    int availableH = d->subgridSize - h - 2 * margin;
     if (availableW < 0) availableW = 0;
     if (availableH < 0) availableH = 0;
 
     // Random left/top within the quadrant
-    int roomLeft = quadX + margin + rand() % (availableW + 1);
-    int roomTop  = quadY + margin + rand() % (availableH + 1);
+    int roomLeft = quadX + margin + rngRange(&d->rng, availableW + 1);
+    int roomTop  = quadY + margin + rngRange(&d->rng, availableH + 1);
 
     r->x      = roomLeft;
     r->y      = roomTop;
@@ -253,22 +758,22 @@ static void createTiledRoom(TiledRoom *r, int gx, int gy)
 }
 
 /**
- * positionRoomsInQuadrants: For every 3x3 cell marked as existing (rooms[y][x] == 1),
+ * positionRoomsInQuadrants: For every macro cell marked as existing (ROOM(d, x, y) == 1),
  * create a random TiledRoom within that cell’s corresponding subgrid in bigMap.
  */
-void positionRoomsInQuadrants()
+void positionRoomsInQuadrants(Dungeon *d)
 {
-    for (int gy = 0; gy < SIZE; gy++) {
-        for (int gx = 0; gx < SIZE; gx++) {
+    for (int gy = 0; gy < d->gridH; gy++) {
+        for (int gx = 0; gx < d->gridW; gx++) {
             // Default to no room
-            tiledRooms[gy][gx].exists = 0;
+            TROOM(d, gx, gy).exists = 0;
 
-            // If the 3x3 cell is not a room, skip
-            if (!rooms[gy][gx]) 
+            // If the macro cell is not a room, skip
+            if (!ROOM(d, gx, gy)) 
                 continue;
 
             // Otherwise, create the TiledRoom
-            createTiledRoom(&tiledRooms[gy][gx], gx, gy);
+            createTiledRoom(d, &TROOM(d, gx, gy), gx, gy);
         }
     }
 }
@@ -277,48 +782,40 @@ void positionRoomsInQuadrants()
  * drawRoom: Uses box-drawing characters to draw the perimeter of a single TiledRoom
  * and fills the interior with "." 
  */
-void drawRoom(const TiledRoom *r)
+void drawRoom(Dungeon *d, const TiledRoom *r)
 {
     int left   = r->x;
     int top    = r->y;
     int right  = left + r->width - 1;
     int bottom = top + r->height - 1;
 
-    // Corners
-    strncpy(bigMap[top][left],     "┌", 4);
-    strncpy(bigMap[top][right],    "┐", 4);
-    strncpy(bigMap[bottom][left],  "└", 4);
-    strncpy(bigMap[bottom][right], "┘", 4);
-
-    // Top/bottom edges
-    for (int x = left + 1; x < right; x++) {
-        strncpy(bigMap[top][x],    "─", 4);
-        strncpy(bigMap[bottom][x], "─", 4);
-    }
+    // Top/bottom edges, then the floor between them
+    fillTileRect(d, left + 1, top, r->width - 2, 1, TILE_WALL_H);
+    fillTileRect(d, left + 1, bottom, r->width - 2, 1, TILE_WALL_H);
+    fillTileRect(d, left + 1, top + 1, r->width - 2, r->height - 2, TILE_FLOOR);
 
     // Left/right edges
     for (int y = top + 1; y < bottom; y++) {
-        strncpy(bigMap[y][left],  "│", 4);
-        strncpy(bigMap[y][right], "│", 4);
+        TILE(d, left, y)  = TILE_WALL_V;
+        TILE(d, right, y) = TILE_WALL_V;
     }
 
-    // Fill interior
-    for (int y = top + 1; y < bottom; y++) {
-        for (int x = left + 1; x < right; x++) {
-            strncpy(bigMap[y][x], ".", 4);
-        }
-    }
+    // Corners
+    TILE(d, left, top)     = TILE_CORNER_TL;
+    TILE(d, right, top)    = TILE_CORNER_TR;
+    TILE(d, left, bottom)  = TILE_CORNER_BL;
+    TILE(d, right, bottom) = TILE_CORNER_BR;
 }
 
 /**
  * drawAllRooms: Iterates over all TiledRooms and calls drawRoom() on each that exists.
  */
-void drawAllRooms()
+void drawAllRooms(Dungeon *d)
 {
-    for (int gy = 0; gy < SIZE; gy++) {
-        for (int gx = 0; gx < SIZE; gx++) {
-            if (tiledRooms[gy][gx].exists) {
-                drawRoom(&tiledRooms[gy][gx]);
+    for (int gy = 0; gy < d->gridH; gy++) {
+        for (int gx = 0; gx < d->gridW; gx++) {
+            if (TROOM(d, gx, gy).exists) {
+                drawRoom(d, &TROOM(d, gx, gy));
             }
         }
     }
@@ -326,7 +823,7 @@ void drawAllRooms()
 
 /*
  * ------------------------------------------------------------
- * Corridor Carving in the 30x30 map
+ * Corridor Carving in the tiled map
  * ------------------------------------------------------------
  *
  * The carveCorridor function draws an L-shaped corridor of box-drawing glyphs
@@ -335,76 +832,43 @@ void drawAllRooms()
  */
 
 /**
- * carveCorridor: Draws a corridor path between (x1,y1) and (x2,y2).
- *  - isHoriz indicates that the overall connection is west→east if true,
- *    or north→south if false (used for picking corner glyphs).
+ * carveLeg: Carves the straight run of corridor from (x1,y1) to (x2,y2),
+ * which share a row or a column, ends included.
  */
-void carveCorridor(int x1, int y1, int x2, int y2, int isHoriz)
+static void carveLeg(Dungeon *d, int x1, int y1, int x2, int y2)
 {
-    // Randomly pick if we move X-first or Y-first to get an L-shape
-    int doXFirst = rand() % 2;
-    if (x1 == x2) doXFirst = 0; // purely vertical
-    if (y1 == y2) doXFirst = 1; // purely horizontal
-
-    // If start == end, just place a single glyph
-    if (x1 == x2 && y1 == y2) {
-        setCell(x1, y1, "▒");
-        return;
-    }
-
-    // (1) Place a "start tile"
-    setCell(x1, y1, "▒");
-
-    // (2) Phase 1: Move along one axis until we match x2 or y2
-    int dx = 0, dy = 0;
-    if (doXFirst) {
-        dx = (x2 > x1) ? +1 : -1;
-        while (x1 != x2) {
-            x1 += dx;
-            setCell(x1, y1, "▒");
-        }
+    if (y1 == y2) {
+        setRowSpan(d, x1 < x2 ? x1 : x2, y1, abs(x2 - x1) + 1, TILE_CORRIDOR);
     } else {
-        dy = (y2 > y1) ? +1 : -1;
-        while (y1 != y2) {
-            y1 += dy;
-            setCell(x1, y1, "▒");
-        }
+        setColumnSpan(d, x1, y1 < y2 ? y1 : y2, abs(y2 - y1) + 1, TILE_CORRIDOR);
     }
+}
 
-    // (3) If there's leftover distance in the other axis => place a pivot corner + Phase 2
-    int stillHaveX = (x1 != x2);
-    int stillHaveY = (y1 != y2);
-
-    // dx,dy after Phase1 show how we moved in that phase
-    int oldDx = dx, oldDy = dy;
+/**
+ * carveCorridor: Draws an L-shaped corridor path between (x1,y1) and (x2,y2).
+ */
+void carveCorridor(Dungeon *d, int x1, int y1, int x2, int y2)
+{
+    // Randomly pick if we move X-first or Y-first to get an L-shape
+    int doXFirst = rngRange(&d->rng, 2);
+    if (x1 == x2) doXFirst = 0; // purely vertical
+    if (y1 == y2) doXFirst = 1; // purely horizontal
 
-    // If we haven't matched both x2,y2 => L-shape
-    if (stillHaveX || stillHaveY) {
-        // Decide the new direction for Phase2
-        int newDx = 0, newDy = 0;
-        if (doXFirst && (y1 != y2)) {
-            newDy = (y2 > y1) ? +1 : -1;
-        } else if (!doXFirst && (x1 != x2)) {
-            newDx = (x2 > x1) ? +1 : -1;
-        }
+    d->stats.corridorTiles += abs(x2 - x1) + abs(y2 - y1) + 1;
 
-        // Place a pivot corner glyph at the current pivot (x1,y1)
-        setCell(x1, y1, "▒");
+    // The pivot is where the L turns; it equals the end tile when the
+    // corridor is straight (or a single glyph)
+    int px = doXFirst ? x2 : x1;
+    int py = doXFirst ? y1 : y2;
 
-        // Phase2
-        dx = newDx;
-        dy = newDy;
-        while (x1 != x2 || y1 != y2) {
-            x1 += dx;
-            y1 += dy;
-            setCell(x1, y1, "▒");
-        }
+    // (1) Phase 1: start tile to pivot, then (2) Phase 2: the tile after
+    // the pivot to the end, each one straight span
+    carveLeg(d, x1, y1, px, py);
+    if (px != x2 || py != y2) {
+        int sx = (x2 > px) - (x2 < px);
+        int sy = (y2 > py) - (y2 < py);
+        carveLeg(d, px + sx, py + sy, x2, y2);
     }
-
-    // (4) Place the "end tile"
-    // We see if we ended horizontally or vertically for the last step
-    int endDx = dx, endDy = dy;
-    setCell(x1, y1, "▒");
 }
 
 /*
@@ -417,21 +881,21 @@ void carveCorridor(int x1, int y1, int x2, int y2, int isHoriz)
  * randomWallCoordinate: picks a random coordinate along a wall of the room,
  * skipping the corners (width - 2).
  */
-static int randomWallCoordinate(int start, int dimension)
+static int randomWallCoordinate(Dungeon *d, int start, int dimension)
 {
     // dimension is either room->width or room->height
     // We skip the corners => [start+1, start+dimension-2]
-    return start + 1 + rand() % (dimension - 2);
+    return start + 1 + rngRange(&d->rng, dimension - 2);
 }
 
 /**
  * placeHorizontalDoors: Handles the case where there's a horizontal corridor 
  * between (gx,gy) and (gx+1,gy).
  */
-static void placeHorizontalDoors(int gx, int gy)
+static void placeHorizontalDoors(Dungeon *d, int gx, int gy)
 {
-    TiledRoom *r1 = &tiledRooms[gy][gx];
-    TiledRoom *r2 = &tiledRooms[gy][gx + 1];
+    TiledRoom *r1 = &TROOM(d, gx, gy);
+    TiledRoom *r2 = &TROOM(d, gx + 1, gy);
 
     // Coordinates of the two rooms in bigMap
     int right1 = r1->x + r1->width - 1;
@@ -442,25 +906,25 @@ static void placeHorizontalDoors(int gx, int gy)
         return;
     }
     // Pick random Y positions on each room's vertical wall
-    int doorY1 = randomWallCoordinate(r1->y, r1->height);
-    int doorY2 = randomWallCoordinate(r2->y, r2->height);
+    int doorY1 = randomWallCoordinate(d, r1->y, r1->height);
+    int doorY2 = randomWallCoordinate(d, r2->y, r2->height);
 
     // Mark each door cell with "╬"
-    strncpy(bigMap[doorY1][right1], "╬", 4); // east wall of R1
-    strncpy(bigMap[doorY2][left2],  "╬", 4); // west wall of R2
+    TILE(d, right1, doorY1) = TILE_DOOR; // east wall of R1
+    TILE(d, left2, doorY2) = TILE_DOOR; // west wall of R2
 
     // Carve corridor from the space after R1's wall to the space before R2's wall
-    carveCorridor(right1 + 1, doorY1, left2 - 1, doorY2, /*isHoriz=*/1);
+    carveCorridor(d, right1 + 1, doorY1, left2 - 1, doorY2);
 }
 
 /**
  * placeVerticalDoors: Handles the case where there's a vertical corridor 
  * between (gx,gy) and (gx,gy+1).
  */
-static void placeVerticalDoors(int gx, int gy)
+static void placeVerticalDoors(Dungeon *d, int gx, int gy)
 {
-    TiledRoom *r1 = &tiledRooms[gy][gx];
-    TiledRoom *r2 = &tiledRooms[gy + 1][gx];
+    TiledRoom *r1 = &TROOM(d, gx, gy);
+    TiledRoom *r2 = &TROOM(d, gx, gy + 1);
 
     // Coordinates of the two rooms in bigMap
     int bottom1 = r1->y + r1->height - 1;
@@ -472,39 +936,39 @@ static void placeVerticalDoors(int gx, int gy)
     }
 
     // Pick random X positions on each room's horizontal wall
-    int doorX1 = randomWallCoordinate(r1->x, r1->width);
-    int doorX2 = randomWallCoordinate(r2->x, r2->width);
+    int doorX1 = randomWallCoordinate(d, r1->x, r1->width);
+    int doorX2 = randomWallCoordinate(d, r2->x, r2->width);
 
     // Mark each door cell with "╬"
-    strncpy(bigMap[bottom1][doorX1], "╬", 4); 
-    strncpy(bigMap[top2][doorX2],    "╬", 4);
+    TILE(d, doorX1, bottom1) = TILE_DOOR; 
+    TILE(d, doorX2, top2) = TILE_DOOR;
 
     // Carve corridor from the space after R1's bottom to the space before R2's top
-    carveCorridor(doorX1, bottom1 + 1, doorX2, top2 - 1, /*isHoriz=*/0);
+    carveCorridor(d, doorX1, bottom1 + 1, doorX2, top2 - 1);
 }
 
 /**
- * placeDoorsForCorridors: For each pair of adjacent rooms in the 3x3 grid
+ * placeDoorsForCorridors: For each pair of adjacent rooms in the macro grid
  * that share a corridor, place matching door tiles on facing walls,
  * then carve an L-shaped corridor in the bigMap connecting them.
  */
-void placeDoorsForCorridors()
+void placeDoorsForCorridors(Dungeon *d)
 {
-    for (int gy = 0; gy < SIZE; gy++) {
-        for (int gx = 0; gx < SIZE; gx++) {
-            if (!tiledRooms[gy][gx].exists) 
+    for (int gy = 0; gy < d->gridH; gy++) {
+        for (int gx = 0; gx < d->gridW; gx++) {
+            int c = gy * d->gridW + gx;
+            if (!TROOM(d, gx, gy).exists) 
                 continue;
 
-            // If there's a horizontal corridor to (gx+1,gy)
-            if (gx < SIZE - 1 && horizontal_corridors[gy][gx] == 1) {
-                if (tiledRooms[gy][gx + 1].exists) {
-                    placeHorizontalDoors(gx, gy);
-                }
-            }
-            // If there's a vertical corridor to (gx,gy+1)
-            if (gy < SIZE - 1 && vertical_corridors[gy][gx] == 1) {
-                if (tiledRooms[gy + 1][gx].exists) {
-                    placeVerticalDoors(gx, gy);
+            // Each pair once: only the east and south neighbours, which
+            // the macro graph lists in that order
+            for (int e = d->graphStart[c]; e < d->graphStart[c + 1]; e++) {
+                int n = d->graphAdj[e];
+                if (n < c || !(d->graphFlags[n] & MACRO_ROOM)) continue;
+                if (n == c + 1 && n / d->gridW == gy) {
+                    placeHorizontalDoors(d, gx, gy);
+                } else {
+                    placeVerticalDoors(d, gx, gy);
                 }
             }
         }
@@ -520,50 +984,30 @@ void placeDoorsForCorridors()
  * countCorridorsForCell: returns how many corridor connections 
  * this cell (gx, gy) has (both horizontal & vertical).
  */
-int countCorridorsForCell(int gx, int gy)
+int countCorridorsForCell(const Dungeon *d, int gx, int gy)
 {
-    int count = 0;
-
-    // If there's a horizontal corridor from (gx,gy) to (gx+1,gy)
-    if (gx < SIZE - 1 && horizontal_corridors[gy][gx])
-        count++;
-    // If there's a horizontal corridor from (gx-1,gy) to (gx,gy)
-    if (gx > 0 && horizontal_corridors[gy][gx - 1])
-        count++;
-
-    // If there's a vertical corridor from (gx,gy) to (gx,gy+1)
-    if (gy < SIZE - 1 && vertical_corridors[gy][gx])
-        count++;
-    // If there's a vertical corridor from (gx,gy-1) to (gx,gy)
-    if (gy > 0 && vertical_corridors[gy - 1][gx])
-        count++;
-
-    return count;
+    return DEGREE(d, gy * d->gridW + gx);
 }
 
 // Now we define a new function that draws corridor junction
 // in the subgrid for "removed" cells
-void drawMissingRoomJunctions()
+void drawMissingRoomJunctions(Dungeon *d)
 {
-    for (int gy = 0; gy < SIZE; gy++) {
-        for (int gx = 0; gx < SIZE; gx++) {
+    for (int gy = 0; gy < d->gridH; gy++) {
+        for (int gx = 0; gx < d->gridW; gx++) {
             // If the corridor adjacency says that cell was connected
             // but the 'room' is removed => place a junction tile
-            if (!tiledRooms[gy][gx].exists) {
-                // See if we have corridors leading in or out:
-                int ccount = countCorridorsForCell(gx, gy);
-                if (ccount > 0) {
-                    int subgridX = gx * SUBGRID_SIZE;
-                    int subgridY = gy * SUBGRID_SIZE;
-
-                    // Middle of the subgrid
-                    int centerX = subgridX + SUBGRID_SIZE/2;
-                    int centerY = subgridY + SUBGRID_SIZE/2;
-
-                    // Let's place a "▒"
-                    // Something that indicates a pass-thru node.
-                    setCell(centerX, centerY, "▒");
-                }
+            if (d->graphFlags[gy * d->gridW + gx] & MACRO_NODE) {
+                int subgridX = gx * d->subgridSize;
+                int subgridY = gy * d->subgridSize;
+
+                // Middle of the subgrid
+                int centerX = subgridX + d->subgridSize/2;
+                int centerY = subgridY + d->subgridSize/2;
+
+                // Let's place a "▒"
+                // Something that indicates a pass-thru node.
+                setCell(d, centerX, centerY, TILE_CORRIDOR);
             }
         }
     }
@@ -571,173 +1015,164 @@ void drawMissingRoomJunctions()
 
 /**
  * connectNodesWithCorridors:
- * For each 3x3 cell that is NOT a room (rooms[gy][gx]==0) but has corridor adjacency,
- * carve corridors from its “center tile” to the neighbor’s door or neighbor’s center.
+ * For each macro cell that is NOT a room (a MACRO_NODE in the macro graph),
+ * carve corridors from its “center tile” to each neighbour’s door or
+ * neighbour’s center.
  * This ensures the “junction” is actually connected in the bigMap,
  * *with the rule* that we always start from the left or top cell
  * and end at the right or bottom cell.
  */
-void connectNodesWithCorridors()
+void connectNodesWithCorridors(Dungeon *d)
 {
-    for (int gy = 0; gy < SIZE; gy++) {
-        for (int gx = 0; gx < SIZE; gx++) {
+    for (int gy = 0; gy < d->gridH; gy++) {
+        for (int gx = 0; gx < d->gridW; gx++) {
+            int c = gy * d->gridW + gx;
 
             // If we do not have a room but do have adjacency => it's a node
-            if (rooms[gy][gx] == 0) {
-                int ccount = countCorridorsForCell(gx, gy);
-                if (ccount > 0) {
-                    // Node’s center tile
-                    int nodeCenterX = gx * SUBGRID_SIZE + (SUBGRID_SIZE / 2);
-                    int nodeCenterY = gy * SUBGRID_SIZE + (SUBGRID_SIZE / 2);
+            if (!(d->graphFlags[c] & MACRO_NODE)) continue;
+
+            // Node’s center tile
+            int nodeCenterX = gx * d->subgridSize + (d->subgridSize / 2);
+            int nodeCenterY = gy * d->subgridSize + (d->subgridSize / 2);
+
+            // Neighbours come east, west, south, north (see buildMacroGraph)
+            for (int e = d->graphStart[c]; e < d->graphStart[c + 1]; e++) {
+                int n = d->graphAdj[e];
+                int ngx = n % d->gridW, ngy = n / d->gridW;
 
+                if (ngx > gx) {
                     // --------------------------------------------------
                     // RIGHT NEIGHBOR
                     // --------------------------------------------------
-                    if (gx < SIZE - 1 && horizontal_corridors[gy][gx]) {
-                        // There's a corridor to the cell on the right: (gx+1, gy)
-                        // Always treat the left cell (this node) as start, right as end
-                        // so (startX < endX) for a horizontal corridor.
-                        if (rooms[gy][gx + 1] == 1) {
-                            // node → real room
-                            TiledRoom* r = &tiledRooms[gy][gx + 1];
-                            if (r->exists) {
-                                int doorX = r->x;  // left wall of that room
-                                int doorY = randomWallCoordinate(r->y, r->height);
-
-                                // place door
-                                strncpy(bigMap[doorY][doorX], "╬", 4); //
-
-                                // carve from nodeCenterX+1 to doorX-1
-                                carveCorridor(nodeCenterX + 1, nodeCenterY,
-                                              doorX - 1, doorY,
-                                              /*isHoriz=*/1);
-                            }
-                        } else {
-                            // node → node
-                            int neighborCenterX = (gx + 1) * SUBGRID_SIZE + (SUBGRID_SIZE / 2);
-                            int neighborCenterY = gy * SUBGRID_SIZE + (SUBGRID_SIZE / 2);
-
-                            // ensure we treat the left X as start, right X as end
-                            int startX = (nodeCenterX < neighborCenterX ? nodeCenterX : neighborCenterX);
-                            int endX   = (nodeCenterX < neighborCenterX ? neighborCenterX : nodeCenterX);
-
-                            carveCorridor(startX + 1, nodeCenterY,
-                                          endX - 1, neighborCenterY,
-                                          /*isHoriz=*/1);
+                    // There's a corridor to the cell on the right: (gx+1, gy)
+                    // Always treat the left cell (this node) as start, right as end
+                    // so (startX < endX) for a horizontal corridor.
+                    if (ROOM(d, gx + 1, gy) == 1) {
+                        // node → real room
+                        TiledRoom* r = &TROOM(d, gx + 1, gy);
+                        if (r->exists) {
+                            int doorX = r->x;  // left wall of that room
+                            int doorY = randomWallCoordinate(d, r->y, r->height);
+
+                            // place door
+                            TILE(d, doorX, doorY) = TILE_DOOR; //
+
+                            // carve from nodeCenterX+1 to doorX-1
+                            carveCorridor(d, nodeCenterX + 1, nodeCenterY,
+                                          doorX - 1, doorY);
                         }
-                    }
+                    } else {
+                        // node → node
+                        int neighborCenterX = (gx + 1) * d->subgridSize + (d->subgridSize / 2);
+                        int neighborCenterY = gy * d->subgridSize + (d->subgridSize / 2);
+
+                        // ensure we treat the left X as start, right X as end
+                        int startX = (nodeCenterX < neighborCenterX ? nodeCenterX : neighborCenterX);
+                        int endX   = (nodeCenterX < neighborCenterX ? neighborCenterX : nodeCenterX);
 
+                        carveCorridor(d, startX + 1, nodeCenterY,
+                                      endX - 1, neighborCenterY);
+                    }
+                } else if (ngx < gx) {
                     // --------------------------------------------------
                     // LEFT NEIGHBOR
                     // --------------------------------------------------
-                    if (gx > 0 && horizontal_corridors[gy][gx - 1]) {
-                        // There's a corridor to the cell on the left: (gx-1, gy)
-                        // Always treat the left cell as start, right cell as end.
-                        if (rooms[gy][gx - 1] == 1) {
-                            // room → node or node → room
-                            // But in terms of X, the smaller X is the start.
-                            TiledRoom* r = &tiledRooms[gy][gx - 1];
-                            if (r->exists) {
-                                int doorX = r->x + r->width - 1;  // right wall of that room
-                                int doorY = randomWallCoordinate(r->y, r->height);
-
-                                strncpy(bigMap[doorY][doorX], "╬", 4);
-
-                                // We want the smaller X to be start, so:
-                                int startX = (doorX < nodeCenterX) ? doorX : nodeCenterX;
-                                int endX   = (doorX < nodeCenterX) ? nodeCenterX : doorX;
-
-                                carveCorridor(startX + 1, doorY,
-                                              endX - 1, nodeCenterY,
-                                              /*isHoriz=*/1);
-                            }
-                        } else {
-                            // node → node horizontally
-                            int neighborCenterX = (gx - 1) * SUBGRID_SIZE + (SUBGRID_SIZE / 2);
-                            int neighborCenterY = gy * SUBGRID_SIZE + (SUBGRID_SIZE / 2);
-
-                            // smaller X is start, bigger X is end
-                            int startX = (neighborCenterX < nodeCenterX ? neighborCenterX : nodeCenterX);
-                            int endX   = (neighborCenterX < nodeCenterX ? nodeCenterX : neighborCenterX);
-
-                            carveCorridor(startX + 1, neighborCenterY,
-                                          endX - 1, nodeCenterY,
-                                          /*isHoriz=*/1);
+                    // There's a corridor to the cell on the left: (gx-1, gy)
+                    // Always treat the left cell as start, right cell as end.
+                    if (ROOM(d, gx - 1, gy) == 1) {
+                        // room → node or node → room
+                        // But in terms of X, the smaller X is the start.
+                        TiledRoom* r = &TROOM(d, gx - 1, gy);
+                        if (r->exists) {
+                            int doorX = r->x + r->width - 1;  // right wall of that room
+                            int doorY = randomWallCoordinate(d, r->y, r->height);
+
+                            TILE(d, doorX, doorY) = TILE_DOOR;
+
+                            // We want the smaller X to be start, so:
+                            int startX = (doorX < nodeCenterX) ? doorX : nodeCenterX;
+                            int endX   = (doorX < nodeCenterX) ? nodeCenterX : doorX;
+
+                            carveCorridor(d, startX + 1, doorY,
+                                          endX - 1, nodeCenterY);
                         }
-                    }
+                    } else {
+                        // node → node horizontally
+                        int neighborCenterX = (gx - 1) * d->subgridSize + (d->subgridSize / 2);
+                        int neighborCenterY = gy * d->subgridSize + (d->subgridSize / 2);
 
+                        // smaller X is start, bigger X is end
+                        int startX = (neighborCenterX < nodeCenterX ? neighborCenterX : nodeCenterX);
+                        int endX   = (neighborCenterX < nodeCenterX ? nodeCenterX : neighborCenterX);
+
+                        carveCorridor(d, startX + 1, neighborCenterY,
+                                      endX - 1, nodeCenterY);
+                    }
+                } else if (ngy > gy) {
                     // --------------------------------------------------
                     // DOWN NEIGHBOR
                     // --------------------------------------------------
-                    if (gy < SIZE - 1 && vertical_corridors[gy][gx]) {
-                        // There's a corridor to the cell below: (gx, gy+1)
-                        // Always treat the top cell as start, bottom as end
-                        if (rooms[gy + 1][gx] == 1) {
-                            // node → real room
-                            TiledRoom* r = &tiledRooms[gy + 1][gx];
-                            if (r->exists) {
-                                int doorX = r->x + (r->width / 2);
-                                int doorY = r->y;  // top wall
-
-                                strncpy(bigMap[doorY][doorX], "╬", 4);
-
-                                // smaller Y is start, bigger Y is end
-                                int startY = (nodeCenterY < doorY ? nodeCenterY : doorY);
-                                int endY   = (nodeCenterY < doorY ? doorY : nodeCenterY);
-
-                                carveCorridor(nodeCenterX, startY + 1,
-                                              doorX, endY - 1,
-                                              /*isHoriz=*/0);
-                            }
-                        } else {
-                            // node → node vertically
-                            int neighborCenterX = gx * SUBGRID_SIZE + (SUBGRID_SIZE / 2);
-                            int neighborCenterY = (gy + 1)*SUBGRID_SIZE + (SUBGRID_SIZE / 2);
+                    // There's a corridor to the cell below: (gx, gy+1)
+                    // Always treat the top cell as start, bottom as end
+                    if (ROOM(d, gx, gy + 1) == 1) {
+                        // node → real room
+                        TiledRoom* r = &TROOM(d, gx, gy + 1);
+                        if (r->exists) {
+                            int doorX = r->x + (r->width / 2);
+                            int doorY = r->y;  // top wall
+
+                            TILE(d, doorX, doorY) = TILE_DOOR;
+
+                            // smaller Y is start, bigger Y is end
+                            int startY = (nodeCenterY < doorY ? nodeCenterY : doorY);
+                            int endY   = (nodeCenterY < doorY ? doorY : nodeCenterY);
+
+                            carveCorridor(d, nodeCenterX, startY + 1,
+                                          doorX, endY - 1);
+                        }
+                    } else {
+                        // node → node vertically
+                        int neighborCenterX = gx * d->subgridSize + (d->subgridSize / 2);
+                        int neighborCenterY = (gy + 1)*d->subgridSize + (d->subgridSize / 2);
 
-                            // top is start, bottom is end
-                            int startY = (nodeCenterY < neighborCenterY ? nodeCenterY : neighborCenterY);
-                            int endY   = (nodeCenterY < neighborCenterY ? neighborCenterY : nodeCenterY);
+                        // top is start, bottom is end
+                        int startY = (nodeCenterY < neighborCenterY ? nodeCenterY : neighborCenterY);
+                        int endY   = (nodeCenterY < neighborCenterY ? neighborCenterY : nodeCenterY);
 
-                            carveCorridor(nodeCenterX, startY + 1,
-                                          neighborCenterX, endY - 1,
-                                          /*isHoriz=*/0);
-                        }
+                        carveCorridor(d, nodeCenterX, startY + 1,
+                                      neighborCenterX, endY - 1);
                     }
-
+                } else {
                     // --------------------------------------------------
                     // UP NEIGHBOR
                     // --------------------------------------------------
-                    if (gy > 0 && vertical_corridors[gy - 1][gx]) {
-                        // There's a corridor to the cell above: (gx, gy-1)
-                        // Always treat the top cell as start, bottom as end
-                        if (rooms[gy - 1][gx] == 1) {
-                            TiledRoom* r = &tiledRooms[gy - 1][gx];
-                            if (r->exists) {
-                                int doorX = r->x + (r->width / 2);
-                                int doorY = r->y + r->height - 1; // bottom wall
-
-                                strncpy(bigMap[doorY][doorX], "╬", 4);
-
-                                // top is start, bottom is end
-                                int startY = (doorY < nodeCenterY ? doorY : nodeCenterY);
-                                int endY   = (doorY < nodeCenterY ? nodeCenterY : doorY);
-
-                                carveCorridor(doorX, startY + 1,
-                                              nodeCenterX, endY - 1,
-                                              /*isHoriz=*/0);
-                            }
-                        } else {
-                            // node → node
-                            int neighborCenterX = gx * SUBGRID_SIZE + (SUBGRID_SIZE / 2);
-                            int neighborCenterY = (gy - 1)*SUBGRID_SIZE + (SUBGRID_SIZE / 2);
-
-                            int startY = (neighborCenterY < nodeCenterY ? neighborCenterY : nodeCenterY);
-                            int endY   = (neighborCenterY < nodeCenterY ? nodeCenterY : neighborCenterY);
-
-                            carveCorridor(nodeCenterX, startY + 1,
-                                          neighborCenterX, endY - 1,
-                                          /*isHoriz=*/0);
+                    // There's a corridor to the cell above: (gx, gy-1)
+                    // Always treat the top cell as start, bottom as end
+                    if (ROOM(d, gx, gy - 1) == 1) {
+                        TiledRoom* r = &TROOM(d, gx, gy - 1);
+                        if (r->exists) {
+                            int doorX = r->x + (r->width / 2);
+                            int doorY = r->y + r->height - 1; // bottom wall
+
+                            TILE(d, doorX, doorY) = TILE_DOOR;
+
+                            // top is start, bottom is end
+                            int startY = (doorY < nodeCenterY ? doorY : nodeCenterY);
+                            int endY   = (doorY < nodeCenterY ? nodeCenterY : doorY);
+
+                            carveCorridor(d, doorX, startY + 1,
+                                          nodeCenterX, endY - 1);
                         }
+                    } else {
+                        // node → node
+                        int neighborCenterX = gx * d->subgridSize + (d->subgridSize / 2);
+                        int neighborCenterY = (gy - 1)*d->subgridSize + (d->subgridSize / 2);
+
+                        int startY = (neighborCenterY < nodeCenterY ? neighborCenterY : nodeCenterY);
+                        int endY   = (neighborCenterY < nodeCenterY ? nodeCenterY : neighborCenterY);
+
+                        carveCorridor(d, nodeCenterX, startY + 1,
+                                      neighborCenterX, endY - 1);
                     }
                 }
             }
@@ -750,32 +1185,29 @@ void connectNodesWithCorridors()
  * picks one at random, and places the player in the center of that TiledRoom 
  * (or anywhere within).
  */
-void placePlayerInEdgeRoom()
+void placePlayerInEdgeRoom(Dungeon *d)
 {
-    // Collect all candidate rooms
-    int candidates[SIZE*SIZE][2];
+    // Collect all candidate rooms (as cell indices gy * gridW + gx)
+    int *candidates = d->queue;
     int ccount = 0;
 
-    for (int gy = 0; gy < SIZE; gy++) {
-        for (int gx = 0; gx < SIZE; gx++) {
-            if (!tiledRooms[gy][gx].exists) continue;
+    for (int gy = 0; gy < d->gridH; gy++) {
+        for (int gx = 0; gx < d->gridW; gx++) {
+            if (!TROOM(d, gx, gy).exists) continue;
 
-            int corridorCount = countCorridorsForCell(gx, gy);
+            int corridorCount = countCorridorsForCell(d, gx, gy);
             if (corridorCount == 1) {
-                candidates[ccount][0] = gx;
-                candidates[ccount][1] = gy;
-                ccount++;
+                candidates[ccount++] = gy * d->gridW + gx;
             }
         }
     }
 
     // If we found none, fallback: place in any existing room
     if (ccount == 0) {
-        for (int gy = 0; gy < SIZE && ccount==0; gy++) {
-            for (int gx = 0; gx < SIZE && ccount==0; gx++) {
-                if (tiledRooms[gy][gx].exists) {
-                    candidates[0][0] = gx;
-                    candidates[0][1] = gy;
+        for (int gy = 0; gy < d->gridH && ccount==0; gy++) {
+            for (int gx = 0; gx < d->gridW && ccount==0; gx++) {
+                if (TROOM(d, gx, gy).exists) {
+                    candidates[0] = gy * d->gridW + gx;
                     ccount = 1;
                 }
             }
@@ -783,12 +1215,12 @@ void placePlayerInEdgeRoom()
     }
 
     // Random pick among the candidates
-    int pick = rand() % ccount;
-    int gx = candidates[pick][0];
-    int gy = candidates[pick][1];
+    int pick = rngRange(&d->rng, ccount);
+    int gx = candidates[pick] % d->gridW;
+    int gy = candidates[pick] / d->gridW;
 
     // Place player near the center of that TiledRoom
-    TiledRoom *r = &tiledRooms[gy][gx];
+    TiledRoom *r = &TROOM(d, gx, gy);
 
     int px = r->x + r->width / 2;
     int py = r->y + r->height / 2;
@@ -796,30 +1228,30 @@ void placePlayerInEdgeRoom()
     // Make sure it's on top of a "." or some floor
     // For simplicity, we assume interior was "."
 
-    playerX = px;
-    playerY = py;
+    d->playerX = px;
+    d->playerY = py;
 
     // Mark the bigMap with "@" for the player
-    setCell(playerX, playerY, "@");
+    setCell(d, d->playerX, d->playerY, TILE_PLAYER);
 }
 
 /**
  * placeTreasureInRandomRoom: picks a random TiledRoom (not the player's),
  * places 'T' in a random interior tile. 
  */
-void placeTreasureInRandomRoom()
+void placeTreasureInRandomRoom(Dungeon *d)
 {
     // Collect all rooms except the one the player is in
     // First, find which room the player is in:
     int playerRoomGX = -1, playerRoomGY = -1;
 
     // Identify which TiledRoom contains the player's (playerX,playerY)
-    for (int gy = 0; gy < SIZE; gy++) {
-        for (int gx = 0; gx < SIZE; gx++) {
-            if (!tiledRooms[gy][gx].exists) continue;
-            TiledRoom *r = &tiledRooms[gy][gx];
-            if (playerX >= r->x && playerX < r->x + r->width &&
-                playerY >= r->y && playerY < r->y + r->height) {
+    for (int gy = 0; gy < d->gridH; gy++) {
+        for (int gx = 0; gx < d->gridW; gx++) {
+            if (!TROOM(d, gx, gy).exists) continue;
+            TiledRoom *r = &TROOM(d, gx, gy);
+            if (d->playerX >= r->x && d->playerX < r->x + r->width &&
+                d->playerY >= r->y && d->playerY < r->y + r->height) {
                 playerRoomGX = gx;
                 playerRoomGY = gy;
                 break;
@@ -827,138 +1259,97 @@ void placeTreasureInRandomRoom()
         }
     }
 
-    // Gather all other rooms
-    int candidates[SIZE*SIZE][2];
+    // Gather all other rooms (as cell indices gy * gridW + gx)
+    int *candidates = d->queue;
     int ccount = 0;
-    for (int gy = 0; gy < SIZE; gy++) {
-        for (int gx = 0; gx < SIZE; gx++) {
-            if (!tiledRooms[gy][gx].exists) continue;
+    for (int gy = 0; gy < d->gridH; gy++) {
+        for (int gx = 0; gx < d->gridW; gx++) {
+            if (!TROOM(d, gx, gy).exists) continue;
             if (gx == playerRoomGX && gy == playerRoomGY) continue;
-            candidates[ccount][0] = gx;
-            candidates[ccount][1] = gy;
-            ccount++;
+            candidates[ccount++] = gy * d->gridW + gx;
         }
     }
 
     if (ccount == 0) {
         // Edge case: all rooms are the same or no other rooms
         // Just skip placing treasure
+        d->treasureX = d->treasureY = -1;
         return;
     }
 
     // Pick one at random
-    int pick = rand() % ccount;
-    int gx = candidates[pick][0];
-    int gy = candidates[pick][1];
-    TiledRoom *r = &tiledRooms[gy][gx];
+    int pick = rngRange(&d->rng, ccount);
+    int gx = candidates[pick] % d->gridW;
+    int gy = candidates[pick] / d->gridW;
+    TiledRoom *r = &TROOM(d, gx, gy);
 
     // Place T somewhere in that room’s interior
-    int tx = r->x + 1 + rand() % (r->width - 2);
-    int ty = r->y + 1 + rand() % (r->height - 2);
+    int tx = r->x + 1 + rngRange(&d->rng, r->width - 2);
+    int ty = r->y + 1 + rngRange(&d->rng, r->height - 2);
 
-    setCell(tx, ty, "T");
+    d->treasureX = tx;
+    d->treasureY = ty;
+    setCell(d, tx, ty, TILE_TREASURE);
 }
 
 /**
- * findFarthestRoom: BFS from (startGX, startGY) across the 3x3 adjacency,
- * returns the (gx,gy) with the greatest distance that is a room (exists=1).
+ * findFarthestRoom: BFS from (startGX, startGY) across the macro graph,
+ * through rooms and corridor junctions alike, and returns the (gx,gy) of
+ * the room farthest from the start other than the start itself (or the
+ * start when no other room can be reached).
  */
-void findFarthestRoom(int startGX, int startGY, int *outGX, int *outGY)
+void findFarthestRoom(Dungeon *d, int startGX, int startGY, int *outGX, int *outGY)
 {
+    int cells = d->gridW * d->gridH;
+    int start = startGY * d->gridW + startGX;
+
     // Initialize dist
-    for (int y=0; y<SIZE; y++) {
-        for (int x=0; x<SIZE; x++) {
-            dist[y][x] = -1; // unvisited
-        }
-    }
-    dist[startGY][startGX] = 0;
+    for (int i = 0; i < cells; i++) d->dist[i] = -1; // unvisited
+    d->dist[start] = 0;
 
-    // BFS queue
-    int queue[SIZE*SIZE][2];
+    // BFS queue (cell indices gy * gridW + gx)
+    int *queue = d->queue;
     int front = 0, back = 0;
+    queue[back++] = start;
 
-    // Enqueue start
-    queue[back][0] = startGX;
-    queue[back][1] = startGY;
-    back++;
-
-    // BFS
     while (front < back) {
-        int gx = queue[front][0];
-        int gy = queue[front][1];
-        front++;
-        int d = dist[gy][gx];
-
-        // Check neighbors
-        // Right
-        if (gx < SIZE-1 && horizontal_corridors[gy][gx] && rooms[gy][gx+1]) {
-            if (dist[gy][gx+1] == -1) {
-                dist[gy][gx+1] = d + 1;
-                queue[back][0] = gx+1;
-                queue[back][1] = gy;
-                back++;
-            }
-        }
-        // Left
-        if (gx > 0 && horizontal_corridors[gy][gx-1] && rooms[gy][gx-1]) {
-            if (dist[gy][gx-1] == -1) {
-                dist[gy][gx-1] = d + 1;
-                queue[back][0] = gx-1;
-                queue[back][1] = gy;
-                back++;
-            }
-        }
-        // Down
-        if (gy < SIZE-1 && vertical_corridors[gy][gx] && rooms[gy+1][gx]) {
-            if (dist[gy+1][gx] == -1) {
-                dist[gy+1][gx] = d + 1;
-                queue[back][0] = gx;
-                queue[back][1] = gy+1;
-                back++;
-            }
-        }
-        // Up
-        if (gy > 0 && vertical_corridors[gy-1][gx] && rooms[gy-1][gx]) {
-            if (dist[gy-1][gx] == -1) {
-                dist[gy-1][gx] = d + 1;
-                queue[back][0] = gx;
-                queue[back][1] = gy-1;
-                back++;
+        int c = queue[front++];
+        int cd = d->dist[c];
+        for (int e = d->graphStart[c]; e < d->graphStart[c + 1]; e++) {
+            int n = d->graphAdj[e];
+            if (d->dist[n] == -1) {
+                d->dist[n] = cd + 1;
+                queue[back++] = n;
             }
         }
     }
 
     // Now find the cell with the largest dist that is a room
-    int bestDist = -1;
-    int bestGX = startGX, bestGY = startGY;
-    for (int gy=0; gy<SIZE; gy++) {
-        for (int gx=0; gx<SIZE; gx++) {
-            if (rooms[gy][gx] && dist[gy][gx] != -1) {
-                if (dist[gy][gx] > bestDist) {
-                    bestDist = dist[gy][gx];
-                    bestGX = gx;
-                    bestGY = gy;
-                }
-            }
+    int bestDist = 0;
+    int best = start;
+    for (int i = 0; i < cells; i++) {
+        if ((d->graphFlags[i] & MACRO_ROOM) && d->dist[i] > bestDist) {
+            bestDist = d->dist[i];
+            best = i;
         }
     }
 
-    // printf("Farthest room is (%d,%d) with dist %d\n", bestGX, bestGY, bestDist);
+    // printf("Farthest room is (%d,%d) with dist %d\n", best % d->gridW, best / d->gridW, bestDist);
 
-    *outGX = bestGX;
-    *outGY = bestGY;
+    *outGX = best % d->gridW;
+    *outGY = best / d->gridW;
 }
 
-void placeExitFarthestFromPlayer()
+void placeExitFarthestFromPlayer(Dungeon *d)
 {
-    // Which 3x3 room is the player in?
+    // Which macro room is the player in?
     int playerRoomGX=-1, playerRoomGY=-1;
-    for (int gy=0; gy<SIZE; gy++) {
-        for (int gx=0; gx<SIZE; gx++) {
-            if (!tiledRooms[gy][gx].exists) continue;
-            TiledRoom *r = &tiledRooms[gy][gx];
-            if (playerX >= r->x && playerX < r->x + r->width &&
-                playerY >= r->y && playerY < r->y + r->height) {
+    for (int gy=0; gy < d->gridH; gy++) {
+        for (int gx=0; gx < d->gridW; gx++) {
+            if (!TROOM(d, gx, gy).exists) continue;
+            TiledRoom *r = &TROOM(d, gx, gy);
+            if (d->playerX >= r->x && d->playerX < r->x + r->width &&
+                d->playerY >= r->y && d->playerY < r->y + r->height) {
                 playerRoomGX = gx;
                 playerRoomGY = gy;
                 break;
@@ -969,290 +1360,4223 @@ void placeExitFarthestFromPlayer()
     // printf("Player is in room (%d,%d)\n", playerRoomGX, playerRoomGY);
 
     int farGX, farGY;
-    findFarthestRoom(playerRoomGX, playerRoomGY, &farGX, &farGY);
-    TiledRoom *farRoom = &tiledRooms[farGY][farGX];
-
-    // Place "E" in a random interior tile
-    int ex = farRoom->x + 1 + rand() % (farRoom->width - 2);
-    int ey = farRoom->y + 1 + rand() % (farRoom->height - 2);
-
-    setCell(ex, ey, "E");
+    findFarthestRoom(d, playerRoomGX, playerRoomGY, &farGX, &farGY);
+    TiledRoom *farRoom = &TROOM(d, farGX, farGY);
+
+    // Place "E" in a random interior tile, never on top of the player or
+    // the treasure (the far room can be the treasure's, or the player's
+    // on a single-room level)
+    int ex, ey;
+    do {
+        ex = farRoom->x + 1 + rngRange(&d->rng, farRoom->width - 2);
+        ey = farRoom->y + 1 + rngRange(&d->rng, farRoom->height - 2);
+    } while ((ex == d->playerX && ey == d->playerY)
+             || (ex == d->treasureX && ey == d->treasureY));
+
+    d->exitX = ex;
+    d->exitY = ey;
+    setCell(d, ex, ey, TILE_EXIT);
 }
 
-/**
- * ncursesPrintTile: Responsible for printing one tile and optionally
- * "stretching" it (like "══") if needed.
+/*
+ * ------------------------------------------------------------
+ * Flow Fields
+ * ------------------------------------------------------------
+ *
+ * A flow field is one breadth-first search over bigMap from a target
+ * (the player), storing for every tile it reaches the distance to the
+ * target and the direction of the first step towards it. Any number of
+ * monsters can then walk towards the player with one lookup each per
+ * turn instead of a search each.
  *
- * @param row     The ncurses row
- * @param col     The ncurses column to start printing
- * @param cell    The current tile's string (e.g. "═", "┌", ".")
- * @param nextCell The next tile in the row (to decide if we want to merge horizontally)
+ * Tiles are tagged with the generation (stamp) of the search that last
+ * reached them, so a new search never has to clear the arrays: a tile is
+ * part of the current field only if its stamp matches. A search is only
+ * run when the target has moved, and stops at maxDist steps, so its cost
+ * depends on the area around the player rather than on the map size.
  *
- * @return The number of columns printed. Typically 1 or 2.
+ * When the player moves, the field is rebuilt from scratch within
+ * FLOW_RADIUS rather than patched from the old one. A one-step move
+ * changes the distance of nearly every tile in the field by one, so a
+ * patch would visit about as many tiles as the search does. Monsters more
+ * than FLOW_RADIUS steps from the player are outside the field and stand
+ * still until it comes within reach.
+ */
+
+#define FLOW_RADIUS 128         // steps searched around the player in the game
+#define FLOW_MAX_DIST (UINT16_MAX - 1) // largest maxDist the uint16_t distances hold
+
+// Step directions, in WASD order; FLOW_NONE marks the target itself
+enum { FLOW_UP, FLOW_DOWN, FLOW_LEFT, FLOW_RIGHT, FLOW_NONE };
+static const int flowDX[4] = { 0, 0, -1, 1 };
+static const int flowDY[4] = { -1, 1, 0, 0 };
+
+typedef struct {
+    int w, h;               // map size the field covers; 0 = no field
+    uint32_t gen;           // stamp of the current field
+    uint32_t *stamp;        // per tile: gen of the search that last reached it
+    uint16_t *dist;         // per tile: steps to the target
+    unsigned char *dir;     // per tile: FLOW_* first step towards the target
+    int *queue;             // scratch: BFS queue (tile indices)
+    int targetX, targetY;   // target of the current field, -1 = none
+    int maxDist;
+
+    long updates;           // searches run
+    long tilesVisited;      // tiles reached over all searches
+} FlowField;
+
+/**
+ * flowFieldBytesNeeded: How large a buffer flowFieldInit() needs for a
+ * w x h map.
  */
-static int ncursesPrintTile(int row, int col, const char *cell, const char *nextCell)
+size_t flowFieldBytesNeeded(int w, int h)
 {
-    // Same logic as your printTile() but using mvaddstr.
-    // We'll return how many columns we used.
-    if (strncmp(cell, "╬", 4) == 0 &&
-             (strncmp(nextCell, "▒", 4) == 0)) // "╬▒"
-    {
-        mvaddstr(row, col, "╬▒");
-        return 2;
-    }
-    else if (strncmp(cell, "▒", 4) == 0 && (strncmp(nextCell, "▒", 4) == 0 || 
-                                        strncmp(nextCell, "╬", 4) == 0)) {
-        mvaddstr(row, col, "▒▒");
-        return 2;
-    }
-    else if (strncmp(cell, "─", 4) == 0) {
-        mvaddstr(row, col, "──");
-        return 2;
-    }
-    else if (strncmp(cell, "┌", 4) == 0 &&
-             (strncmp(nextCell, "─", 4) == 0 || strncmp(nextCell, "╬", 4) == 0))
-    {
-        mvaddstr(row, col, "┌─");
-        return 2;
-    }
-    else if (strncmp(cell, "└", 4) == 0 &&
-             (strncmp(nextCell, "─", 4) == 0 || strncmp(nextCell, "╬", 4) == 0))
-    {
-        mvaddstr(row, col, "└─");
-        return 2;
-    }
-    else if (strncmp(cell, "╬", 4) == 0 &&
-             (strncmp(nextCell, "─", 4) == 0 ||
-              strncmp(nextCell, "┐", 4) == 0 ||
-              strncmp(nextCell, "┘", 4) == 0))
-    {
-        mvaddstr(row, col, "╬─");
-        return 2;
-    }
-    else {
-        // Default: print cell as a single character (plus any spacing)
-        // e.g. ".", " ", "T", "E", "@", etc.
-        mvaddstr(row, col, cell);
-        return 1;
-    }
+    size_t tiles = (size_t)w * h;
+    return ((tiles * sizeof(uint32_t) + 7) & ~(size_t)7)
+         + ((tiles * sizeof(uint16_t) + 7) & ~(size_t)7)
+         + ((tiles + 7) & ~(size_t)7)
+         + ((tiles * sizeof(int) + 7) & ~(size_t)7);
 }
 
-/////////////////////////////////////////////
-static int isWalkable(const char *cell)
+/**
+ * flowFieldInit: Sets up an empty flow field for a w x h map, with its
+ * arrays carved from `buffer` like dungeonInit().
+ * @return 0 on success, -1 if the buffer is too small.
+ */
+int flowFieldInit(FlowField *f, int w, int h, void *buffer, size_t bufferSize)
 {
-    // You might refine this as needed
-    if (strncmp(cell, ".", 4) == 0) return 1;
-    if (strncmp(cell, "T", 4) == 0) return 1;
-    if (strncmp(cell, "E", 4) == 0) return 1;
-    if (strncmp(cell, "╬", 4) == 0) return 1;
-    if (strncmp(cell, "▒", 4) == 0) return 1;
-    // corridor glyphs? Doors? It's up to you:
-    // if (strncmp(cell, "╬") == 0) return 1; // maybe
-
+    if (flowFieldBytesNeeded(w, h) > bufferSize) return -1;
+
+    size_t tiles = (size_t)w * h;
+    unsigned char *cursor = buffer;
+    size_t left = bufferSize;
+
+    f->w = w;
+    f->h = h;
+    f->stamp = arenaTake(&cursor, &left, tiles * sizeof(uint32_t));
+    f->dist  = arenaTake(&cursor, &left, tiles * sizeof(uint16_t));
+    f->dir   = arenaTake(&cursor, &left, tiles);
+    f->queue = arenaTake(&cursor, &left, tiles * sizeof(int));
+    memset(f->stamp, 0, tiles * sizeof(uint32_t));
+    f->gen = 1;             // searches start at 2, so no tile is in a field yet
+    f->targetX = f->targetY = -1;
+    f->maxDist = 0;
+    f->updates = 0;
+    f->tilesVisited = 0;
     return 0;
 }
 
 /**
- * drawBigMapNcurses: Clear screen, then draw the bigMap in ncurses.
+ * flowFieldInvalidate: Forces the next flowFieldUpdate() to search again,
+ * e.g. after the map itself changed.
  */
-void drawBigMapNcurses()
+void flowFieldInvalidate(FlowField *f)
 {
-    for (int y = 0; y < BIG_SIZE; y++) {
-
-        int cursorX = 0;
-
-        for (int x = 0; x < BIG_SIZE; x++) {
-            // Print the entire string stored in bigMap[y][x]
-            // mvaddstr(y, x * 2, bigMap[y][x]);
+    f->targetX = f->targetY = -1;
+}
 
-            // Look ahead to the next cell for "stretch" logic
-            const char *nextCell = (x + 1 < BIG_SIZE) ? bigMap[y][x+1] : " ";
+/**
+ * flowFieldUpdate: Makes `f` lead to (tx,ty) over the walkable tiles of
+ * `d`, up to maxDist steps away (at most FLOW_MAX_DIST). Does nothing if
+ * the field already leads there.
+ */
+void flowFieldUpdate(FlowField *f, const Dungeon *d, int tx, int ty, int maxDist)
+{
+    if (f->w != d->bigW || f->h != d->bigH) return;
+    if (maxDist > FLOW_MAX_DIST) maxDist = FLOW_MAX_DIST;
+    if (tx == f->targetX && ty == f->targetY && maxDist == f->maxDist) return;
+
+    // A new stamp invalidates every tile at once; clear only on wraparound
+    if (++f->gen == 0) {
+        memset(f->stamp, 0, (size_t)f->w * f->h * sizeof(uint32_t));
+        f->gen = 1;
+    }
+    f->targetX = tx;
+    f->targetY = ty;
+    f->maxDist = maxDist;
+    f->updates++;
 
-            // Print the current tile in ncurses
-            // This returns how many columns we actually used.
-            int usedCols = ncursesPrintTile(y, cursorX, bigMap[y][x], nextCell);
+    int *queue = f->queue;
+    int front = 0, back = 0;
+    int start = ty * f->w + tx;
+    f->stamp[start] = f->gen;
+    f->dist[start] = 0;
+    f->dir[start] = FLOW_NONE;
+    queue[back++] = start;
 
-            // Advance cursorX by however many columns we used
-            cursorX += 2;
+    while (front < back) {
+        int cur = queue[front++];
+        int cd = f->dist[cur];
+        if (cd >= maxDist) continue;
+
+        int x = cur % f->w, y = cur / f->w;
+        for (int k = 0; k < 4; k++) {
+            int nx = x + flowDX[k], ny = y + flowDY[k];
+            if (nx < 0 || nx >= f->w || ny < 0 || ny >= f->h) continue;
+            int n = ny * f->w + nx;
+            if (f->stamp[n] == f->gen || !isWalkable(d, nx, ny)) continue;
+
+            // We reached n by stepping k from cur, so from n the way back
+            // to the target is the opposite direction (k ^ 1)
+            f->stamp[n] = f->gen;
+            f->dist[n] = (uint16_t)(cd + 1);
+            f->dir[n] = (unsigned char)(k ^ 1);
+            queue[back++] = n;
         }
     }
-    refresh();
+    f->tilesVisited += back;
 }
 
 /**
- * gameLoopNcurses: 
- *  - Waits for WASD or Q
- *  - Moves player if next cell is walkable
- *  - If we step on 'T', show message, remove 'T'
- *  - If we step on 'E', show message, end game
+ * flowFieldStep: The direction (FLOW_*) of the first step from (x,y)
+ * towards the target, or FLOW_NONE if (x,y) is the target or outside the
+ * field.
  */
-void gameLoopNcurses()
+int flowFieldStep(const FlowField *f, int x, int y)
 {
-    setlocale(LC_ALL, "");
-    initscr();
-    noecho();
-    cbreak();
-    keypad(stdscr, TRUE);
+    size_t i = (size_t)y * f->w + x;
+    return f->stamp[i] == f->gen ? f->dir[i] : FLOW_NONE;
+}
 
-    // We'll store what's underneath the player:
-    // For the first time, assume it's floor "." (or whatever you like)
-    char prevTile[4] = ".";
+/**
+ * flowFieldDistance: Steps from (x,y) to the target, or -1 if (x,y) is
+ * outside the field.
+ */
+int flowFieldDistance(const FlowField *f, int x, int y)
+{
+    size_t i = (size_t)y * f->w + x;
+    return f->stamp[i] == f->gen ? f->dist[i] : -1;
+}
 
-    // Hide the cursor
-    curs_set(0);
+// The field leading to the player in the game; see main()
+FlowField playerFlow;
 
-    // Draw once
-    drawBigMapNcurses();
+/*
+ * ------------------------------------------------------------
+ * Path Finding
+ * ------------------------------------------------------------
+ *
+ * pathFind() is A* over the walkable tiles, sped up with jump point
+ * search for 4-connected grids. Of all the shortest paths between two
+ * tiles it only looks for the ones that go vertically first and turn only
+ * where they must: a search moving straight ahead skips every tile where
+ * no such path can turn (the tile has no "forced" neighbour) and only
+ * stops, and pushes a node onto the open list, where one can. Moving
+ * vertically, it also looks sideways from each tile, since a path may
+ * turn there to reach a jump point further along the row. Corridors and
+ * room interiors then cost a handful of open list operations instead of
+ * one per tile.
+ */
 
-    while (gameRunning) {
+typedef struct {
+    int w, h;               // map size the scratch arrays cover; 0 = none
+    uint32_t gen;           // stamp of the current search
+    uint32_t *stamp;        // per tile: gen of the search that last reached it
+    int *g;                 // per tile: cost from the start
+    int *parent;            // per tile: previous jump point on the best path
+    int *heapPos;           // per tile: index in heap, -1 once closed
+    int *heap;              // open list: binary min-heap of tile indices
+    int heapSize;
+    unsigned char *steps;   // the path found: FLOW_* directions from the start
+    int goalX, goalY;
+
+    long searches;          // pathFind() calls
+    long expanded;          // nodes taken off the open list
+} PathFinder;
+
+/**
+ * pathFinderBytesNeeded: How large a buffer pathFinderInit() needs for a
+ * w x h map.
+ */
+size_t pathFinderBytesNeeded(int w, int h)
+{
+    size_t tiles = (size_t)w * h;
+    return 5 * ((tiles * sizeof(int) + 7) & ~(size_t)7) + ((tiles + 7) & ~(size_t)7);
+}
+
+/**
+ * pathFinderInit: Sets up path finding scratch for a w x h map, carved
+ * from `buffer` like dungeonInit().
+ * @return 0 on success, -1 if the buffer is too small.
+ */
+int pathFinderInit(PathFinder *p, int w, int h, void *buffer, size_t bufferSize)
+{
+    if (pathFinderBytesNeeded(w, h) > bufferSize) return -1;
+
+    size_t tiles = (size_t)w * h;
+    unsigned char *cursor = buffer;
+    size_t left = bufferSize;
+
+    p->w = w;
+    p->h = h;
+    p->stamp   = arenaTake(&cursor, &left, tiles * sizeof(uint32_t));
+    p->g       = arenaTake(&cursor, &left, tiles * sizeof(int));
+    p->parent  = arenaTake(&cursor, &left, tiles * sizeof(int));
+    p->heapPos = arenaTake(&cursor, &left, tiles * sizeof(int));
+    p->heap    = arenaTake(&cursor, &left, tiles * sizeof(int));
+    p->steps   = arenaTake(&cursor, &left, tiles);
+    memset(p->stamp, 0, tiles * sizeof(uint32_t));
+    p->gen = 0;
+    p->searches = 0;
+    p->expanded = 0;
+    return 0;
+}
+
+// Walkability with everything outside the map counted as blocked
+static int walkableAt(const Dungeon *d, int x, int y)
+{
+    return x >= 0 && x < d->bigW && y >= 0 && y < d->bigH && isWalkable(d, x, y);
+}
+
+// A* priority of tile i: cost so far plus the Manhattan distance left
+static int pathPriority(const PathFinder *p, int i)
+{
+    return p->g[i] + abs(i % p->w - p->goalX) + abs(i / p->w - p->goalY);
+}
+
+// Orders the open list by priority, preferring the node further along
+// (larger g) on ties so searches run towards the goal
+static int heapLess(const PathFinder *p, int a, int b)
+{
+    int fa = pathPriority(p, a), fb = pathPriority(p, b);
+    return fa < fb || (fa == fb && p->g[a] > p->g[b]);
+}
+
+static void heapSiftUp(PathFinder *p, int pos)
+{
+    int node = p->heap[pos];
+    while (pos > 0) {
+        int up = (pos - 1) / 2;
+        if (!heapLess(p, node, p->heap[up])) break;
+        p->heap[pos] = p->heap[up];
+        p->heapPos[p->heap[pos]] = pos;
+        pos = up;
+    }
+    p->heap[pos] = node;
+    p->heapPos[node] = pos;
+}
+
+static int heapPop(PathFinder *p)
+{
+    int top = p->heap[0];
+    int node = p->heap[--p->heapSize];
+    int pos = 0;
+
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= p->heapSize) break;
+        if (child + 1 < p->heapSize && heapLess(p, p->heap[child + 1], p->heap[child])) child++;
+        if (!heapLess(p, p->heap[child], node)) break;
+        p->heap[pos] = p->heap[child];
+        p->heapPos[p->heap[pos]] = pos;
+        pos = child;
+    }
+    if (p->heapSize > 0) {
+        p->heap[pos] = node;
+        p->heapPos[node] = pos;
+    }
+    p->heapPos[top] = -1;   // closed
+    return top;
+}
+
+/**
+ * jump: Moves from (x,y) in direction (dx,dy) until it reaches the goal or
+ * a tile where a canonical path can turn.
+ * @return The tile index of that jump point, or -1 if a wall comes first.
+ */
+static int jump(const PathFinder *p, const Dungeon *d, int x, int y, int dx, int dy)
+{
+    for (;;) {
+        x += dx;
+        y += dy;
+        if (!walkableAt(d, x, y)) return -1;
+        if (x == p->goalX && y == p->goalY) return y * p->w + x;
+
+        if (dx != 0) {
+            // A side opening that a tile behind us doesn't have
+            if ((walkableAt(d, x, y - 1) && !walkableAt(d, x - dx, y - 1)) ||
+                (walkableAt(d, x, y + 1) && !walkableAt(d, x - dx, y + 1))) {
+                return y * p->w + x;
+            }
+        } else {
+            if ((walkableAt(d, x - 1, y) && !walkableAt(d, x - 1, y - dy)) ||
+                (walkableAt(d, x + 1, y) && !walkableAt(d, x + 1, y - dy))) {
+                return y * p->w + x;
+            }
+            // Vertical moves stop wherever a horizontal jump would succeed
+            if (jump(p, d, x, y, 1, 0) >= 0 || jump(p, d, x, y, -1, 0) >= 0) {
+                return y * p->w + x;
+            }
+        }
+    }
+}
+
+/**
+ * pathFind: Finds a shortest 4-connected path over the walkable tiles of
+ * `d` from (sx,sy) to (gx,gy) and stores it in p->steps.
+ * @return The number of steps, or -1 if the goal cannot be reached.
+ */
+int pathFind(PathFinder *p, const Dungeon *d, int sx, int sy, int gx, int gy)
+{
+    if (p->w != d->bigW || p->h != d->bigH) return -1;
+    if (!walkableAt(d, gx, gy)) return -1;
+    if (sx == gx && sy == gy) return 0;
+
+    // A new stamp forgets the previous search; clear only on wraparound
+    if (++p->gen == 0) {
+        memset(p->stamp, 0, (size_t)p->w * p->h * sizeof(uint32_t));
+        p->gen = 1;
+    }
+    p->goalX = gx;
+    p->goalY = gy;
+    p->searches++;
+
+    int start = sy * p->w + sx;
+    int goal = gy * p->w + gx;
+    p->stamp[start] = p->gen;
+    p->g[start] = 0;
+    p->parent[start] = -1;
+    p->heapSize = 0;
+    p->heap[p->heapSize++] = start;
+    p->heapPos[start] = 0;
+
+    while (p->heapSize > 0) {
+        int cur = heapPop(p);
+        p->expanded++;
+        if (cur == goal) break;
+
+        int x = cur % p->w, y = cur / p->w;
+        // Pruned neighbours: keep going straight, or turn to either side.
+        // The start has no direction yet, so it searches all four.
+        int cand[4][2];
+        int nc = 0;
+        int px = 0, py = 0, dx = 0, dy = 0;
+        if (p->parent[cur] >= 0) {
+            px = p->parent[cur] % p->w;
+            py = p->parent[cur] / p->w;
+            dx = (x > px) - (x < px);
+            dy = (y > py) - (y < py);
+        }
+        if (p->parent[cur] < 0) {
+            for (int k = 0; k < 4; k++) {
+                cand[nc][0] = flowDX[k];
+                cand[nc][1] = flowDY[k];
+                nc++;
+            }
+        } else if (dx != 0) {
+            cand[nc][0] = 0;  cand[nc][1] = -1; nc++;
+            cand[nc][0] = 0;  cand[nc][1] = 1;  nc++;
+            cand[nc][0] = dx; cand[nc][1] = 0;  nc++;
+        } else {
+            cand[nc][0] = -1; cand[nc][1] = 0;  nc++;
+            cand[nc][0] = 1;  cand[nc][1] = 0;  nc++;
+            cand[nc][0] = 0;  cand[nc][1] = dy; nc++;
+        }
+
+        for (int c = 0; c < nc; c++) {
+            int n = jump(p, d, x, y, cand[c][0], cand[c][1]);
+            if (n < 0) continue;
+
+            int ng = p->g[cur] + abs(n % p->w - x) + abs(n / p->w - y);
+            if (p->stamp[n] == p->gen) {
+                // Already closed, or open with a path at least as short
+                if (p->heapPos[n] < 0 || ng >= p->g[n]) continue;
+                p->g[n] = ng;
+                p->parent[n] = cur;
+                heapSiftUp(p, p->heapPos[n]);
+            } else {
+                p->stamp[n] = p->gen;
+                p->g[n] = ng;
+                p->parent[n] = cur;
+                p->heap[p->heapSize] = n;
+                heapSiftUp(p, p->heapSize++);
+            }
+        }
+    }
+    if (p->stamp[goal] != p->gen || p->heapPos[goal] >= 0) return -1;
+
+    // Walk back over the jump points, writing each straight segment's
+    // steps from the end of the path towards its start
+    int len = p->g[goal];
+    int pos = len;
+    for (int n = goal; p->parent[n] >= 0; n = p->parent[n]) {
+        int from = p->parent[n];
+        int fx = from % p->w, fy = from / p->w;
+        int nx = n % p->w, ny = n / p->w;
+        int k = (nx > fx) ? FLOW_RIGHT : (nx < fx) ? FLOW_LEFT
+              : (ny > fy) ? FLOW_DOWN : FLOW_UP;
+        for (int i = abs(nx - fx) + abs(ny - fy); i > 0; i--) {
+            p->steps[--pos] = (unsigned char)k;
+        }
+    }
+    return len;
+}
+
+// Scratch for the travel command; see main()
+PathFinder travelPath;
+
+/*
+ * ------------------------------------------------------------
+ * Monsters
+ * ------------------------------------------------------------
+ *
+ * Monsters are stored as a struct of arrays with a fixed capacity: the
+ * per-turn update walks each array front to back, touching only the
+ * fields it needs. Live monsters are kept packed in [0, count); a dead
+ * monster is replaced by the last one. An occupancy grid (monster index
+ * + 1 per tile, 0 = free) answers "is someone standing here" in O(1).
+ *
+ * Monsters never search for paths themselves: each one follows the
+ * player's flow field, one lookup per move. A monster whose next step is
+ * the player attacks instead of moving; one whose next step is taken by
+ * another monster waits.
+ */
+
+#define MAX_MONSTERS 16384
+#define MONSTER_HP 3
+#define MONSTER_MOVE_ENERGY 100     // energy a monster spends per move
+#define MONSTER_SPAWN_DIST 8      // minimum steps between a new monster and the player
+#define PLAYER_MAX_HP 20
+
+enum { MON_ASLEEP, MON_HUNTING };
+
+typedef struct {
+    int count;
+    uint16_t x[MAX_MONSTERS], y[MAX_MONSTERS];
+    int16_t hp[MAX_MONSTERS];
+    uint8_t state[MAX_MONSTERS];    // MON_*
+    uint8_t speed[MAX_MONSTERS];    // energy gained per turn; 100 = one move, max 200
+    uint16_t energy[MAX_MONSTERS];
+
+    int w, h;                       // map size of the occupancy grid; 0 = none
+    uint16_t *occupant;             // per tile: monster index + 1, 0 = free
+
+    // Tiles (y * w + x) monsters left and entered during the last update,
+    // so the game can mark them dirty; at most two moves per monster
+    int movedCount;
+    int movedFrom[2 * MAX_MONSTERS], movedTo[2 * MAX_MONSTERS];
+
+    long moves;
+    long attacks;
+} Monsters;
+
+/**
+ * monstersBytesNeeded: How large a buffer monstersInit() needs for a
+ * w x h map.
+ */
+size_t monstersBytesNeeded(int w, int h)
+{
+    return ((size_t)w * h * sizeof(uint16_t) + 7) & ~(size_t)7;
+}
+
+/**
+ * monstersInit: Sets up an empty monster list for a w x h map, with the
+ * occupancy grid carved from `buffer`.
+ * @return 0 on success, -1 if the buffer is too small.
+ */
+int monstersInit(Monsters *m, int w, int h, void *buffer, size_t bufferSize)
+{
+    if (monstersBytesNeeded(w, h) > bufferSize) return -1;
+    m->w = w;
+    m->h = h;
+    m->occupant = buffer;
+    memset(m->occupant, 0, (size_t)w * h * sizeof(uint16_t));
+    m->count = 0;
+    m->movedCount = 0;
+    m->moves = 0;
+    m->attacks = 0;
+    return 0;
+}
+
+/**
+ * monstersClear: Removes every monster.
+ */
+void monstersClear(Monsters *m)
+{
+    for (int i = 0; i < m->count; i++) {
+        m->occupant[(size_t)m->y[i] * m->w + m->x[i]] = 0;
+    }
+    m->count = 0;
+    m->movedCount = 0;
+}
+
+/**
+ * monsterAdd: Adds a monster at (x,y), which must be free.
+ * @return Its index, or -1 if the list is full.
+ */
+int monsterAdd(Monsters *m, int x, int y, int hp, int speed)
+{
+    if (m->count >= MAX_MONSTERS) return -1;
+    if (speed > 2 * MONSTER_MOVE_ENERGY) speed = 2 * MONSTER_MOVE_ENERGY;
+    int i = m->count++;
+    m->x[i] = (uint16_t)x;
+    m->y[i] = (uint16_t)y;
+    m->hp[i] = (int16_t)hp;
+    m->state[i] = MON_ASLEEP;
+    m->speed[i] = (uint8_t)speed;
+    m->energy[i] = 0;
+    m->occupant[(size_t)y * m->w + x] = (uint16_t)(i + 1);
+    return i;
+}
+
+/**
+ * monsterRemove: Removes monster i, moving the last monster into its slot.
+ */
+void monsterRemove(Monsters *m, int i)
+{
+    m->occupant[(size_t)m->y[i] * m->w + m->x[i]] = 0;
+    int last = --m->count;
+    if (i == last) return;
+
+    m->x[i] = m->x[last];
+    m->y[i] = m->y[last];
+    m->hp[i] = m->hp[last];
+    m->state[i] = m->state[last];
+    m->speed[i] = m->speed[last];
+    m->energy[i] = m->energy[last];
+    m->occupant[(size_t)m->y[i] * m->w + m->x[i]] = (uint16_t)(i + 1);
+}
+
+/**
+ * monsterAt: Index of the monster standing on (x,y), or -1.
+ */
+int monsterAt(const Monsters *m, int x, int y)
+{
+    if (m->w == 0) return -1;
+    return m->occupant[(size_t)y * m->w + x] - 1;
+}
+
+/**
+ * monstersSpawn: Places up to `n` monsters on random free walkable tiles
+ * of `d`, at least `minDist` steps (Manhattan) from the player. Speeds
+ * vary between half and full speed.
+ * @return The number of monsters placed.
+ */
+int monstersSpawn(Monsters *m, const Dungeon *d, int n, int minDist, uint64_t seed)
+{
+    Rng rng;
+    rngSeed(&rng, seed);
+
+    int placed = 0;
+    long attempts = (long)n * 64;
+    while (placed < n && attempts-- > 0) {
+        int x = rngRange(&rng, d->bigW);
+        int y = rngRange(&rng, d->bigH);
+        if (!isWalkable(d, x, y) || monsterAt(m, x, y) >= 0) continue;
+        if (abs(x - d->playerX) + abs(y - d->playerY) < minDist) continue;
+        if (monsterAdd(m, x, y, MONSTER_HP, 50 + rngRange(&rng, 51)) < 0) break;
+        placed++;
+    }
+    return placed;
+}
+
+/**
+ * monstersUpdate: Runs one turn for every monster. Each gains its speed in
+ * energy and moves one step along the flow field per MONSTER_MOVE_ENERGY
+ * spent; monsters outside the field sleep. Moves are logged in
+ * movedFrom/movedTo.
+ * @return The number of attacks on the player this turn.
+ */
+int monstersUpdate(Monsters *m, const Dungeon *d, const FlowField *f)
+{
+    int hits = 0;
+    int w = m->w;
+    int player = d->playerY * w + d->playerX;
+
+    m->movedCount = 0;
+    for (int i = 0; i < m->count; i++) {
+        unsigned e = m->energy[i] + m->speed[i];
+
+        while (e >= MONSTER_MOVE_ENERGY) {
+            int here = m->y[i] * w + m->x[i];
+            int k = flowFieldStep(f, m->x[i], m->y[i]);
+            if (k == FLOW_NONE) {
+                m->state[i] = MON_ASLEEP;
+                e = 0;
+                break;
+            }
+            m->state[i] = MON_HUNTING;
+            e -= MONSTER_MOVE_ENERGY;
+
+            int next = here + flowDY[k] * w + flowDX[k];
+            if (next == player) {
+                hits++;
+                continue;
+            }
+            if (m->occupant[next]) continue;    // wait for the way to clear
+
+            m->occupant[here] = 0;
+            m->occupant[next] = (uint16_t)(i + 1);
+            m->x[i] = (uint16_t)(next % w);
+            m->y[i] = (uint16_t)(next / w);
+            m->movedFrom[m->movedCount] = here;
+            m->movedTo[m->movedCount] = next;
+            m->movedCount++;
+            m->moves++;
+        }
+        m->energy[i] = (uint16_t)e;
+    }
+    m->attacks += hits;
+    return hits;
+}
+
+// The monsters of the level being played; see main()
+Monsters monsters;
+int monstersPerLevel = 0;   // spawned on every level (--monsters)
+int playerHp = PLAYER_MAX_HP;
+
+/*
+ * ------------------------------------------------------------
+ * Field of View
+ * ------------------------------------------------------------
+ *
+ * What the player can see is found by recursive shadowcasting: each of
+ * the eight octants around the player is scanned row by row outwards,
+ * and every tile that blocks sight narrows the range of slopes scanned
+ * further out. Only tiles within FOV_RADIUS are ever touched.
+ *
+ * Visibility is kept as bitsets (64 tiles per word, like walkBits): the
+ * tiles in view this turn, the ones in view last turn, and the ones ever
+ * seen. XORing this turn's set with last turn's over the two radius
+ * boxes gives exactly the tiles that came into or went out of view, so
+ * the game only redraws those.
+ */
+
+#define FOV_RADIUS 16
+#define FOV_BOX (2 * FOV_RADIUS + 1)
+
+typedef struct {
+    int w, h;                   // map size
+    int words;                  // 64-tile words per bitset row
+    uint64_t *visible;          // in view this turn
+    uint64_t *previous;         // in view last turn
+    uint64_t *explored;         // ever seen
+    int visX, visY;             // center of `visible`, -1 = empty
+    int prevX, prevY;           // center of `previous`, -1 = empty
+
+    // Tiles (y * w + x) that came into or went out of view in the last
+    // fovCompute(); at most every tile of both radius boxes
+    int changedCount;
+    int changed[2 * FOV_BOX * FOV_BOX];
+
+    long computes;
+} Fov;
+
+/**
+ * fovBytesNeeded: How large a buffer fovInit() needs for a w x h map.
+ */
+size_t fovBytesNeeded(int w, int h)
+{
+    return 3 * (size_t)((w + 63) / 64) * h * sizeof(uint64_t);
+}
+
+/**
+ * fovReset: Forgets everything seen (a new level).
+ */
+void fovReset(Fov *f)
+{
+    memset(f->visible, 0, fovBytesNeeded(f->w, f->h));
+    f->visX = f->visY = -1;
+    f->prevX = f->prevY = -1;
+    f->changedCount = 0;
+}
+
+/**
+ * fovInit: Sets up the visibility bitsets for a w x h map, carved from
+ * `buffer`. Nothing is visible or explored yet.
+ * @return 0 on success, -1 if the buffer is too small.
+ */
+int fovInit(Fov *f, int w, int h, void *buffer, size_t bufferSize)
+{
+    if (fovBytesNeeded(w, h) > bufferSize) return -1;
+    size_t n = (size_t)((w + 63) / 64) * h;
+    f->w = w;
+    f->h = h;
+    f->words = (w + 63) / 64;
+    f->visible = buffer;
+    f->previous = f->visible + n;
+    f->explored = f->previous + n;
+    f->computes = 0;
+    fovReset(f);
+    return 0;
+}
+
+/**
+ * castLight: Scans one octant from row `row` outwards, between slopes
+ * `start` and `end` (start > end). The octant is mapped onto the map by
+ * (xx,xy,yx,yy): tile (dx,dy) of the scan is map tile
+ * (cx + dx*xx + dy*xy, cy + dx*yx + dy*yy).
+ */
+static void castLight(Fov *f, const Dungeon *d, int cx, int cy, int row,
+                      double start, double end, int xx, int xy, int yx, int yy)
+{
+    if (start < end) return;
+
+    double newStart = 0.0;
+    for (int j = row; j <= FOV_RADIUS; j++) {
+        int dy = -j;
+        int blocked = 0;
+        for (int dx = -j; dx <= 0; dx++) {
+            double leftSlope = (dx - 0.5) / (dy + 0.5);
+            double rightSlope = (dx + 0.5) / (dy - 0.5);
+            if (start < rightSlope) continue;
+            if (end > leftSlope) break;
+
+            int x = cx + dx * xx + dy * xy;
+            int y = cy + dx * yx + dy * yy;
+            int opaque = 1;
+            if (x >= 0 && x < d->bigW && y >= 0 && y < d->bigH) {
+                if (dx * dx + dy * dy <= FOV_RADIUS * FOV_RADIUS) {
+                    f->visible[(size_t)y * f->words + (x >> 6)] |= 1ULL << (x & 63);
+                }
+                opaque = (PROPS(d, x, y) & PROP_BLOCKS_SIGHT) != 0;
+            }
+
+            if (blocked) {
+                // Still in shadow: keep moving the start of the next scan
+                if (opaque) {
+                    newStart = rightSlope;
+                    continue;
+                }
+                blocked = 0;
+                start = newStart;
+            } else if (opaque && j < FOV_RADIUS) {
+                // A blocker starts: scan the lit part beyond it, then go on
+                // past it in shadow
+                blocked = 1;
+                castLight(f, d, cx, cy, j + 1, start, leftSlope, xx, xy, yx, yy);
+                newStart = rightSlope;
+            }
+        }
+        if (blocked) break;
+    }
+}
+
+// Octant transforms for castLight(): xx, xy, yx, yy per octant
+static const int fovOctants[8][4] = {
+    { 1,  0,  0,  1}, { 0,  1,  1,  0}, { 0, -1,  1,  0}, {-1,  0,  0,  1},
+    {-1,  0,  0, -1}, { 0, -1, -1,  0}, { 0,  1, -1,  0}, { 1,  0,  0, -1},
+};
+
+/**
+ * fovBoxRange: The rows [*y0,*y1] and bitset words [*w0,*w1] covered by
+ * the radius boxes around (ax,ay) and (bx,by); bx < 0 means only a.
+ */
+static void fovBoxRange(const Fov *f, int ax, int ay, int bx, int by,
+                        int *y0, int *y1, int *w0, int *w1)
+{
+    int x0 = ax, x1 = ax;
+    *y0 = *y1 = ay;
+    if (bx >= 0) {
+        if (bx < x0) x0 = bx;
+        if (bx > x1) x1 = bx;
+        if (by < *y0) *y0 = by;
+        if (by > *y1) *y1 = by;
+    }
+    x0 = x0 - FOV_RADIUS > 0 ? x0 - FOV_RADIUS : 0;
+    x1 = x1 + FOV_RADIUS < f->w - 1 ? x1 + FOV_RADIUS : f->w - 1;
+    *y0 = *y0 - FOV_RADIUS > 0 ? *y0 - FOV_RADIUS : 0;
+    *y1 = *y1 + FOV_RADIUS < f->h - 1 ? *y1 + FOV_RADIUS : f->h - 1;
+    *w0 = x0 >> 6;
+    *w1 = x1 >> 6;
+}
+
+/**
+ * fovCompute: Recomputes what can be seen from (px,py), adds it to the
+ * explored set and lists the tiles whose visibility changed in
+ * f->changed. The work is bounded by the radius boxes, not the map size.
+ */
+void fovCompute(Fov *f, const Dungeon *d, int px, int py)
+{
+    int y0, y1, w0, w1;
+
+    // This turn's set reuses the one from two turns ago: clear its box
+    uint64_t *reuse = f->previous;
+    if (f->prevX >= 0) {
+        fovBoxRange(f, f->prevX, f->prevY, -1, -1, &y0, &y1, &w0, &w1);
+        for (int y = y0; y <= y1; y++) {
+            memset(&reuse[(size_t)y * f->words + w0], 0,
+                   (size_t)(w1 - w0 + 1) * sizeof(uint64_t));
+        }
+    }
+    f->previous = f->visible;
+    f->prevX = f->visX;
+    f->prevY = f->visY;
+    f->visible = reuse;
+    f->visX = px;
+    f->visY = py;
+
+    f->visible[(size_t)py * f->words + (px >> 6)] |= 1ULL << (px & 63);
+    for (int o = 0; o < 8; o++) {
+        castLight(f, d, px, py, 1, 1.0, 0.0,
+                  fovOctants[o][0], fovOctants[o][1], fovOctants[o][2], fovOctants[o][3]);
+    }
+
+    // Diff against last turn and remember what is seen
+    f->changedCount = 0;
+    fovBoxRange(f, px, py, f->prevX, f->prevY, &y0, &y1, &w0, &w1);
+    for (int y = y0; y <= y1; y++) {
+        for (int wi = w0; wi <= w1; wi++) {
+            size_t i = (size_t)y * f->words + wi;
+            uint64_t v = f->visible[i];
+            uint64_t diff = v ^ f->previous[i];
+            f->explored[i] |= v;
+            while (diff) {
+                f->changed[f->changedCount++] = y * f->w + wi * 64 + __builtin_ctzll(diff);
+                diff &= diff - 1;
+            }
+        }
+    }
+    f->computes++;
+}
+
+// The player's view of the level being played; see main()
+Fov playerFov;
+int fogOfWar = 1;           // 0 = the whole map is shown (--reveal)
+
+/*
+ * ------------------------------------------------------------
+ * Background Level Generation
+ * ------------------------------------------------------------
+ *
+ * While a level is being played, a worker thread builds the next one into
+ * a second Dungeon, so descending swaps buffers instead of stalling on
+ * generation. The worker and the game race for `claim`: whichever side
+ * takes it first generates the level. If the player gets to the exit before
+ * the worker has even started, the game generates the level itself;
+ * if the worker is already running, the game waits for it to finish.
+ */
+
+void generateLevel(Dungeon *d, uint64_t seed);  // defined after the game loop
+
+enum { PREGEN_FREE, PREGEN_WORKER, PREGEN_CALLER };
+
+typedef struct {
+    Dungeon *next;          // buffer the next level is built into
+    uint64_t seed;
+    atomic_int claim;       // PREGEN_* : who generates the level
+    pthread_t thread;
+    int started;            // 1 if the worker thread must be joined
+    int pending;            // 1 between pregenStart() and pregenFinish()
+    int readyCount;         // levels the worker had finished in time
+    int syncCount;          // levels the caller had to generate itself
+} Pregen;
+
+static void *pregenWorkerMain(void *arg)
+{
+    Pregen *p = arg;
+    int expected = PREGEN_FREE;
+    if (atomic_compare_exchange_strong(&p->claim, &expected, PREGEN_WORKER)) {
+        generateLevel(p->next, p->seed);
+    }
+    return NULL;
+}
+
+/**
+ * pregenStart: Starts building the level for `seed` into `next` in the
+ * background. If the thread cannot be created, pregenFinish() simply
+ * generates the level itself.
+ */
+void pregenStart(Pregen *p, Dungeon *next, uint64_t seed)
+{
+    p->next = next;
+    p->seed = seed;
+    atomic_store(&p->claim, PREGEN_FREE);
+    p->started = pthread_create(&p->thread, NULL, pregenWorkerMain, p) == 0;
+    p->pending = 1;
+}
+
+/**
+ * pregenFinish: Returns the level started by pregenStart(), waiting for
+ * the worker if it is still generating, or generating it here if the
+ * worker never got to it.
+ */
+Dungeon *pregenFinish(Pregen *p)
+{
+    int expected = PREGEN_FREE;
+    if (atomic_compare_exchange_strong(&p->claim, &expected, PREGEN_CALLER)) {
+        generateLevel(p->next, p->seed);
+        p->syncCount++;
+    } else {
+        p->readyCount++;
+    }
+    if (p->started) pthread_join(p->thread, NULL);
+    p->started = 0;
+    p->pending = 0;
+    return p->next;
+}
+
+/**
+ * pregenCancel: Stops a pending pregenStart() whose level is not needed,
+ * waiting for the worker if it already began.
+ */
+void pregenCancel(Pregen *p)
+{
+    if (!p->pending) return;
+    int expected = PREGEN_FREE;
+    atomic_compare_exchange_strong(&p->claim, &expected, PREGEN_CALLER);
+    if (p->started) pthread_join(p->thread, NULL);
+    p->started = 0;
+    p->pending = 0;
+}
+
+/**
+ * stretchedGlyph: Decides whether a tile is drawn "stretched" into both of
+ * its screen columns (like "──") based on the next tile in the row.
+ *
+ * @param tile     The current Tile ID (e.g. TILE_WALL_H, TILE_CORNER_TL, TILE_FLOOR)
+ * @param nextTile The next tile in the row (to decide if we want to merge horizontally)
+ *
+ * @return The two-column string, or NULL if the tile is drawn as its
+ *         single glyph.
+ */
+static const char *stretchedGlyph(unsigned char tile, unsigned char nextTile)
+{
+    if (tile == TILE_DOOR && nextTile == TILE_CORRIDOR) // "╬▒"
+    {
+        return "╬▒";
+    }
+    else if (tile == TILE_CORRIDOR &&
+             (nextTile == TILE_CORRIDOR || nextTile == TILE_DOOR)) {
+        return "▒▒";
+    }
+    else if (tile == TILE_WALL_H) {
+        return "──";
+    }
+    else if (tile == TILE_CORNER_TL &&
+             (nextTile == TILE_WALL_H || nextTile == TILE_DOOR))
+    {
+        return "┌─";
+    }
+    else if (tile == TILE_CORNER_BL &&
+             (nextTile == TILE_WALL_H || nextTile == TILE_DOOR))
+    {
+        return "└─";
+    }
+    else if (tile == TILE_DOOR &&
+             (nextTile == TILE_WALL_H ||
+              nextTile == TILE_CORNER_TR ||
+              nextTile == TILE_CORNER_BR))
+    {
+        return "╬─";
+    }
+    // Default: the tile's glyph as a single character
+    // e.g. ".", " ", "T", "E", "@", etc.
+    return NULL;
+}
+
+/*
+ * renderTable[tile][nextTile]: the exact bytes to print for a tile given
+ * its right neighbour. Every entry covers two screen columns (single
+ * glyphs are padded with a space), so a row is just these concatenated.
+ */
+typedef struct {
+    char text[8];
+    unsigned char len;
+} RenderCell;
+
+static RenderCell renderTable[TILE_COUNT][TILE_COUNT];
+
+/**
+ * initRenderTable: Precomputes renderTable from stretchedGlyph().
+ */
+static void initRenderTable(void)
+{
+    for (int t = 0; t < TILE_COUNT; t++) {
+        for (int n = 0; n < TILE_COUNT; n++) {
+            RenderCell *rc = &renderTable[t][n];
+            const char *s = stretchedGlyph((unsigned char)t, (unsigned char)n);
+            if (s) {
+                snprintf(rc->text, sizeof(rc->text), "%s", s);
+            } else {
+                snprintf(rc->text, sizeof(rc->text), "%s ", tileGlyphs[t]);
+            }
+            rc->len = (unsigned char)strlen(rc->text);
+        }
+    }
+}
+
+// The window of bigMap currently on screen. Maps larger than the terminal
+// scroll when the player gets close to the edge of the window.
+static int viewX, viewY, viewW, viewH;
+
+/*
+ * Dirty tracking for drawBigMapNcurses(). Each dirty map row keeps the
+ * range of columns that changed; only those are redrawn. needFullRedraw
+ * forces a redraw of the whole window (first draw, level change, resize,
+ * or scrolling).
+ */
+#define MAX_BIG_DIM (MAX_GRID_SIZE * MAX_SUBGRID_SIZE)
+static unsigned char rowIsDirty[MAX_BIG_DIM];
+static int dirtyMinX[MAX_BIG_DIM], dirtyMaxX[MAX_BIG_DIM];
+static int dirtyRows[MAX_BIG_DIM];
+static int dirtyRowCount;
+static int needFullRedraw = 1;
+
+/**
+ * markDirty: Records that the tile at (x,y) must be redrawn.
+ */
+static void markDirty(int x, int y)
+{
+    if (needFullRedraw) return;
+
+    // Row not yet in the list => start a new range
+    if (!rowIsDirty[y]) {
+        rowIsDirty[y] = 1;
+        dirtyRows[dirtyRowCount++] = y;
+        dirtyMinX[y] = dirtyMaxX[y] = x;
+        return;
+    }
+    if (x < dirtyMinX[y]) dirtyMinX[y] = x;
+    if (x > dirtyMaxX[y]) dirtyMaxX[y] = x;
+}
+
+/**
+ * requestFullRedraw: Makes the next drawBigMapNcurses() redraw everything.
+ */
+static void requestFullRedraw(void)
+{
+    needFullRedraw = 1;
+}
+
+/**
+ * clearDirty: Empties the dirty row list.
+ */
+static void clearDirty(void)
+{
+    for (int i = 0; i < dirtyRowCount; i++) {
+        rowIsDirty[dirtyRows[i]] = 0;
+    }
+    dirtyRowCount = 0;
+}
+
+/**
+ * updateViewport: Fits the viewport to the terminal size. Keeps the current
+ * scroll position while the player stays at least a quarter of the window
+ * from its edges, otherwise re-centers on the player (clamped to the map).
+ * Requests a full redraw whenever the window moves or changes size.
+ */
+static void updateViewport(const Dungeon *d)
+{
+    int w = d->bigW;
+    int h = d->bigH;
+    if (w > COLS / 2)  w = COLS / 2;   // each tile is 2 columns wide
+    if (h > LINES - 2) h = LINES - 2;  // leave room for the message line
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+
+    int x = viewX, y = viewY;
+    int px = d->playerX - viewX, py = d->playerY - viewY;
+    if (w != viewW || px < w / 4 || px >= w - w / 4) x = d->playerX - w / 2;
+    if (h != viewH || py < h / 4 || py >= h - h / 4) y = d->playerY - h / 2;
+    if (x > d->bigW - w) x = d->bigW - w;
+    if (y > d->bigH - h) y = d->bigH - h;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+
+    if (x != viewX || y != viewY || w != viewW || h != viewH) {
+        needFullRedraw = 1;
+    }
+    viewX = x;
+    viewY = y;
+    viewW = w;
+    viewH = h;
+}
+
+// Text for one span of a map row: at most 6 bytes (two 3-byte glyphs) per tile
+static char renderRow[MAX_BIG_DIM * 6 + 1];
+
+// Bit x of a bitset row
+#define ROW_BIT(row, x) (((row)[(x) >> 6] >> ((x) & 63)) & 1)
+
+/**
+ * drawMapSpan: Draws map row `my`, columns [x0, x1], at their viewport
+ * positions. The text is assembled from renderTable and sent to ncurses
+ * with a single mvaddstr() call. Monsters are drawn on top of the map.
+ * With fog of war, unexplored tiles are blank and monsters only show
+ * where the player can see them.
+ */
+static void drawMapSpan(const Dungeon *d, int my, int x0, int x1)
+{
+    const unsigned char *row = &TILE(d, 0, my);
+    const uint16_t *occ = monsters.count ? &monsters.occupant[(size_t)my * monsters.w] : NULL;
+    const uint64_t *seen = NULL, *lit = NULL;
+    size_t len = 0;
+
+    if (fogOfWar) {
+        seen = &playerFov.explored[(size_t)my * playerFov.words];
+        lit = &playerFov.visible[(size_t)my * playerFov.words];
+    }
+
+    for (int mx = x0; mx <= x1; mx++) {
+        if (seen && seen[mx >> 6] == 0) {
+            // A whole word of unexplored tiles: no lookups at all
+            int end = (mx | 63) < x1 ? (mx | 63) : x1;
+            memset(renderRow + len, ' ', (size_t)(end - mx + 1) * 2);
+            len += (size_t)(end - mx + 1) * 2;
+            mx = end;
+            continue;
+        }
+
+        // Look ahead to the next cell for "stretch" logic
+        unsigned char tile = row[mx];
+        unsigned char nextTile = (mx + 1 < d->bigW) ? row[mx + 1] : TILE_BLANK;
+        if (seen) {
+            if (!ROW_BIT(seen, mx)) tile = TILE_BLANK;
+            if (mx + 1 < d->bigW && !ROW_BIT(seen, mx + 1)) nextTile = TILE_BLANK;
+        }
+
+        // Monsters are drawn over whatever they stand on
+        if (occ) {
+            if (occ[mx] && (!lit || ROW_BIT(lit, mx))) tile = TILE_MONSTER;
+            if (mx + 1 < d->bigW && occ[mx + 1] && (!lit || ROW_BIT(lit, mx + 1))) {
+                nextTile = TILE_MONSTER;
+            }
+        }
+        const RenderCell *rc = &renderTable[tile][nextTile];
+        memcpy(renderRow + len, rc->text, rc->len);
+        len += rc->len;
+    }
+    renderRow[len] = '\0';
+    mvaddstr(my - viewY, (x0 - viewX) * 2, renderRow);
+}
+
+/**
+ * drawBigMapNcurses: Draw the bigMap in ncurses. Redraws the whole window
+ * after requestFullRedraw() or a scroll; otherwise only the tiles passed
+ * to markDirty() since the last call (plus the tile to the left of each,
+ * whose "stretch" glyph depends on its right neighbour).
+ */
+void drawBigMapNcurses(const Dungeon *d)
+{
+    updateViewport(d);
+
+    if (needFullRedraw) {
+        for (int y = 0; y < viewH; y++) {
+            drawMapSpan(d, viewY + y, viewX, viewX + viewW - 1);
+        }
+        needFullRedraw = 0;
+    } else {
+        for (int i = 0; i < dirtyRowCount; i++) {
+            int my = dirtyRows[i];
+            if (my < viewY || my >= viewY + viewH) continue;
+
+            int x0 = dirtyMinX[my] - 1;
+            int x1 = dirtyMaxX[my];
+            if (x0 < viewX) x0 = viewX;
+            if (x1 > viewX + viewW - 1) x1 = viewX + viewW - 1;
+            if (x0 <= x1) drawMapSpan(d, my, x0, x1);
+        }
+    }
+    clearDirty();
+    refresh();
+}
+
+/**
+ * updatePlayerView: Recomputes the player's field of view and marks the
+ * tiles that came into or went out of sight dirty.
+ */
+static void updatePlayerView(const Dungeon *d)
+{
+    if (!fogOfWar) return;
+    fovCompute(&playerFov, d, d->playerX, d->playerY);
+    for (int i = 0; i < playerFov.changedCount; i++) {
+        markDirty(playerFov.changed[i] % d->bigW, playerFov.changed[i] / d->bigW);
+    }
+}
+
+// What a move ran into; see movePlayer()
+enum { MOVE_BLOCKED, MOVE_OK, MOVE_TREASURE, MOVE_EXIT, MOVE_ATTACK, MOVE_KILL };
+
+/**
+ * movePlayer: Moves the player to (newX,newY) if it is walkable, putting
+ * back the tile the player stood on (kept in *prevTile) and picking up
+ * the treasure when stepping on it. Marks both tiles dirty, along with
+ * whatever came into or went out of view. Moving into a monster attacks
+ * it instead.
+ * @return MOVE_BLOCKED if the player could not move, MOVE_ATTACK or
+ *         MOVE_KILL after hitting a monster, otherwise what the player
+ *         stepped on (MOVE_TREASURE, MOVE_EXIT or MOVE_OK).
+ */
+static int movePlayer(Dungeon *d, int newX, int newY, unsigned char *prevTile)
+{
+    // Bounds check
+    if (newX < 0 || newX >= d->bigW || newY < 0 || newY >= d->bigH) {
+        return MOVE_BLOCKED;
+    }
+
+    // Check if walkable
+    if (!isWalkable(d, newX, newY)) {
+        return MOVE_BLOCKED;
+    }
+
+    // Bump attack: the player stays put
+    int mi = monsterAt(&monsters, newX, newY);
+    if (mi >= 0) {
+        if (--monsters.hp[mi] > 0) return MOVE_ATTACK;
+        monsterRemove(&monsters, mi);
+        markDirty(newX, newY);
+        return MOVE_KILL;
+    }
+
+    // ---------------------------------------
+    // 1) Restore the old tile
+    //    (The tile that was under the player, saved in prevTile)
+    // ---------------------------------------
+    setCell(d, d->playerX, d->playerY, *prevTile);
+    markDirty(d->playerX, d->playerY);
+
+    // ---------------------------------------
+    // 2) Figure out what tile is currently at newX,newY
+    //    Save it to prevTile for the next move
+    // ---------------------------------------
+    *prevTile = TILE(d, newX, newY);
+
+    int ev = MOVE_OK;
+    if (*prevTile == TILE_TREASURE) {
+        hasTreasure = 1;
+        // The treasure is "picked up," so the tile effectively becomes ".".
+        *prevTile = TILE_FLOOR;
+        ev = MOVE_TREASURE;
+    } else if (*prevTile == TILE_EXIT) {
+        ev = MOVE_EXIT;
+    }
+
+    // ---------------------------------------
+    // 3) Move the player
+    // ---------------------------------------
+    d->playerX = newX;
+    d->playerY = newY;
+
+    // Place the new player glyph
+    setCell(d, d->playerX, d->playerY, TILE_PLAYER);
+    markDirty(d->playerX, d->playerY);
+    updatePlayerView(d);
+    return ev;
+}
+
+/**
+ * monstersTurn: The monsters' half of a turn: refreshes the flow field
+ * for the player's new position, moves every monster and marks the tiles
+ * they left and entered dirty.
+ * @return The number of times the player was hit.
+ */
+static int monstersTurn(Dungeon *d)
+{
+    turnCount++;
+    flowFieldUpdate(&playerFlow, d, d->playerX, d->playerY, FLOW_RADIUS);
+    if (monsters.count == 0) return 0;
+
+    int hits = monstersUpdate(&monsters, d, &playerFlow);
+    for (int i = 0; i < monsters.movedCount; i++) {
+        markDirty(monsters.movedFrom[i] % d->bigW, monsters.movedFrom[i] / d->bigW);
+        markDirty(monsters.movedTo[i] % d->bigW, monsters.movedTo[i] / d->bigW);
+    }
+    playerHp -= hits;
+    return hits;
+}
+
+/**
+ * travelTo: Walks the player along a shortest path to (tx,ty), stopping
+ * early on the treasure, the exit, a monster in the way, or when hit.
+ * The monsters get a turn after every step. Nothing is drawn on the way;
+ * the caller redraws once afterwards.
+ * @return MOVE_BLOCKED if there is no path (or tx < 0), otherwise the
+ *         result of the last movePlayer(); *hits gets the number of times
+ *         the player was hit.
+ */
+static int travelTo(Dungeon *d, int tx, int ty, unsigned char *prevTile, int *hits)
+{
+    *hits = 0;
+    if (tx < 0) return MOVE_BLOCKED;
+    int steps = pathFind(&travelPath, d, d->playerX, d->playerY, tx, ty);
+    if (steps < 0) return MOVE_BLOCKED;
+
+    int ev = MOVE_OK;
+    for (int i = 0; i < steps && ev == MOVE_OK && *hits == 0; i++) {
+        int k = travelPath.steps[i];
+        ev = movePlayer(d, d->playerX + flowDX[k], d->playerY + flowDY[k], prevTile);
+        if (ev != MOVE_BLOCKED) *hits += monstersTurn(d);
+    }
+    return ev;
+}
+
+/*
+ * A Game is one session's state beyond the dungeon and the globals above:
+ * the level buffers, what lies under the player, and (optionally) the
+ * keys pressed so far, so the session can be saved as a replay.
+ *
+ * levels[0] is the level being played and levels[1] the buffer the next
+ * one is built into in the background (via `pg`); they swap on each
+ * descent, so levels[0] is the last level played when the game ends.
+ */
+typedef struct {
+    Dungeon *levels[2];
+    int levelCount;
+    Pregen *pg;
+    unsigned char prevTile;     // what's underneath the player
+    int hits;                   // times the player was hit by the last key
+
+    unsigned char *keys;        // keys handled so far, NULL = not recording
+    int keyCount, keyCapacity;
+} Game;
+
+// What a key did; see gameHandleKey()
+enum {
+    GAME_IGNORED,       // not a command, or walked into a wall
+    GAME_MOVED,
+    GAME_NO_PATH,       // T / E with nowhere (seen) to travel to
+    GAME_ATTACK,
+    GAME_KILL,
+    GAME_TREASURE,
+    GAME_LOCKED,        // reached the exit without the treasure
+    GAME_DESCEND,       // reached the exit and went down a level
+    GAME_ESCAPED,       // reached the last exit with the treasure
+    GAME_DIED,
+    GAME_QUIT
+};
+
+/**
+ * gameStart: Sets up a new game on levels[0], which must already be
+ * generated: resets the player, starts building the next level, spawns
+ * the monsters and computes the player's first view.
+ */
+void gameStart(Game *g, Dungeon *levels[2], int levelCount, Pregen *pg)
+{
+    Dungeon *d = levels[0];
+
+    g->levels[0] = levels[0];
+    g->levels[1] = levels[1];
+    g->levelCount = levelCount;
+    g->pg = pg;
+    // For the first time, assume the player stands on floor "."
+    g->prevTile = TILE_FLOOR;
+    g->hits = 0;
+    g->keyCount = 0;
+    hasTreasure = 0;
+    gameRunning = 1;
+    currentDepth = 1;
+    turnCount = 0;
+    playerHp = PLAYER_MAX_HP;
+
+    // Start on the next level right away
+    if (currentDepth < levelCount) pregenStart(pg, levels[1], d->seed + 1);
+    flowFieldInvalidate(&playerFlow);
+    flowFieldUpdate(&playerFlow, d, d->playerX, d->playerY, FLOW_RADIUS);
+    monstersClear(&monsters);
+    monstersSpawn(&monsters, d, monstersPerLevel, MONSTER_SPAWN_DIST, d->seed);
+    fovReset(&playerFov);
+    updatePlayerView(d);
+}
+
+/**
+ * gameDescend: Swaps in the level built in the background and starts
+ * building the one after it.
+ */
+static void gameDescend(Game *g)
+{
+    g->levels[1] = g->levels[0];
+    g->levels[0] = pregenFinish(g->pg);
+    Dungeon *d = g->levels[0];
+
+    currentDepth++;
+    hasTreasure = 0;
+    g->prevTile = TILE_FLOOR;
+    if (currentDepth < g->levelCount) pregenStart(g->pg, g->levels[1], d->seed + 1);
+    flowFieldInvalidate(&playerFlow);
+    flowFieldUpdate(&playerFlow, d, d->playerX, d->playerY, FLOW_RADIUS);
+    monstersClear(&monsters);
+    monstersSpawn(&monsters, d, monstersPerLevel, MONSTER_SPAWN_DIST, d->seed);
+    fovReset(&playerFov);
+    updatePlayerView(d);
+}
+
+/**
+ * gameHandleKey: Plays one key: WASD moves (or attacks), T / E travel to
+ * the treasure / exit once it has been seen, Q quits. This is every game rule; nothing here
+ * draws, so it runs the same with or without ncurses. Clears gameRunning
+ * when the game ends; g->hits gets how often the player was hit.
+ * @return A GAME_* value saying what happened.
+ */
+int gameHandleKey(Game *g, int ch)
+{
+    Dungeon *d = g->levels[0];
+
+    if (g->keys && g->keyCount < g->keyCapacity && ch >= 0 && ch < 256) {
+        g->keys[g->keyCount++] = (unsigned char)ch;
+    }
+    g->hits = 0;
+
+    if (ch == 'q' || ch == 'Q') {
+        gameRunning = 0;
+        return GAME_QUIT;
+    }
+
+    int ev;
+    if (ch == 't' || ch == 'T' || ch == 'e' || ch == 'E') {
+        // Travel to the treasure or the exit in one go
+        int isExit = (ch == 'e' || ch == 'E');
+        int tx = isExit ? d->exitX : d->treasureX;
+        int ty = isExit ? d->exitY : d->treasureY;
+        if (!isExit && hasTreasure) tx = -1;
+        // Under fog of war, only somewhere the player has already seen
+        if (tx >= 0 && fogOfWar
+            && !ROW_BIT(&playerFov.explored[(size_t)ty * playerFov.words], tx)) {
+            tx = -1;
+        }
+        ev = travelTo(d, tx, ty, &g->prevTile, &g->hits);
+        if (ev == MOVE_BLOCKED) return GAME_NO_PATH;
+    } else {
+        int newX = d->playerX;
+        int newY = d->playerY;
+
+        if (ch == 'w' || ch == 'W') newY--;
+        if (ch == 's' || ch == 'S') newY++;
+        if (ch == 'a' || ch == 'A') newX--;
+        if (ch == 'd' || ch == 'D') newX++;
+        if (newX == d->playerX && newY == d->playerY) return GAME_IGNORED;
+
+        ev = movePlayer(d, newX, newY, &g->prevTile);
+        if (ev == MOVE_BLOCKED) return GAME_IGNORED;
+        g->hits = monstersTurn(d);
+    }
+
+    if (playerHp <= 0) {
+        gameRunning = 0;
+        return GAME_DIED;
+    }
+    switch (ev) {
+    case MOVE_ATTACK:   return GAME_ATTACK;
+    case MOVE_KILL:     return GAME_KILL;
+    case MOVE_TREASURE: return GAME_TREASURE;
+    case MOVE_EXIT:
+        if (!hasTreasure) return GAME_LOCKED;
+        if (currentDepth < g->levelCount) {
+            gameDescend(g);
+            return GAME_DESCEND;
+        }
+        gameRunning = 0;
+        return GAME_ESCAPED;
+    default:
+        return GAME_MOVED;
+    }
+}
+
+/**
+ * gameLoopNcurses: 
+ *  - Waits for WASD or Q, or T / E to travel to the treasure / exit
+ *  - Plays each key with gameHandleKey()
+ *  - Reports what happened on the message line and redraws what changed
+ *
+ * The game must have been set up with gameStart().
+ */
+void gameLoopNcurses(Game *g)
+{
+    setlocale(LC_ALL, "");
+    initscr();
+    noecho();
+    cbreak();
+    keypad(stdscr, TRUE);
+
+    // Hide the cursor
+    curs_set(0);
+    initRenderTable();
+
+    // Draw once
+    clearDirty();
+    requestFullRedraw();
+    drawBigMapNcurses(g->levels[0]);
+
+    while (gameRunning) {
         int ch = getch();
-        if (ch == 'q' || ch == 'Q') {
-            // Quit
-            gameRunning = 0;
+
+        if (ch == KEY_RESIZE) {
+            // Terminal size changed: start from a blank screen
+            erase();
+            requestFullRedraw();
+            drawBigMapNcurses(g->levels[0]);
+            continue;
+        }
+
+        int ev = gameHandleKey(g, ch);
+        Dungeon *d = g->levels[0];
+
+        // Report what happened; if we stepped on "T" or "E", we might
+        // handle it differently:
+        switch (ev) {
+        case GAME_IGNORED:
+        case GAME_QUIT:
+            continue;
+        case GAME_NO_PATH:
+            mvprintw(viewH+1, 0, "You can't find a way there.           ");
+            continue;
+        case GAME_DESCEND:
+            erase();
+            clearDirty();
+            requestFullRedraw();
+            drawBigMapNcurses(d);
+            mvprintw(viewH+1, 0, "You descend to level %d of %d.", currentDepth, g->levelCount);
+            refresh();
+            continue;
+        case GAME_DIED:
+            mvprintw(viewH+1, 0, "A monster hits you. You die...         ");
+            break;
+        case GAME_ATTACK:
+            mvprintw(viewH+1, 0, "You hit the monster.                  ");
+            break;
+        case GAME_KILL:
+            mvprintw(viewH+1, 0, "You kill the monster.                 ");
+            break;
+        case GAME_TREASURE:
+            mvprintw(viewH+1, 0, "You got the treasure!");
+            break;
+        case GAME_LOCKED:
+            mvprintw(viewH+1, 0, "You found the exit... but no treasure!");
+            break;
+        case GAME_ESCAPED:
+            mvprintw(viewH+1, 0, "You escaped the dungeon!");
             break;
+        default:
+            // If it's not "T" or "E", it's just a regular walkable tile.
+            // We can clear the message line.
+            mvprintw(viewH+1, 0, "                                      ");
+        }
+        if (g->hits > 0 && gameRunning) {
+            mvprintw(viewH+1, 0, "A monster hits you! (HP %d)            ", playerHp);
+        }
+
+        // Redraw what changed
+        drawBigMapNcurses(d);
+    }
+
+    // End curses mode
+    endwin();
+}
+
+/**
+ * gameBuffersInit: Carves everything a game needs from `buffer`: the
+ * level being played, the one being built in the background (only with
+ * more than one level), the player's flow field, the travel command's
+ * path finding scratch, the monster occupancy grid and the field of view
+ * bitsets.
+ * @return 0 on success, -1 if they do not fit (or the size is invalid).
+ */
+int gameBuffersInit(Dungeon *levels[2], int gridW, int gridH, int subgridSize,
+                    int levelCount, void *buffer, size_t bufferSize)
+{
+    unsigned char *base = buffer;
+    Dungeon *d = levels[0];
+    size_t used = 0;
+
+    if (dungeonInit(d, gridW, gridH, subgridSize, base, bufferSize) != 0) return -1;
+    used += dungeonBytesNeeded(gridW, gridH, subgridSize);
+    if (levelCount > 1) {
+        if (dungeonInit(levels[1], gridW, gridH, subgridSize,
+                        base + used, bufferSize - used) != 0) return -1;
+        used += dungeonBytesNeeded(gridW, gridH, subgridSize);
+    }
+    if (flowFieldInit(&playerFlow, d->bigW, d->bigH, base + used, bufferSize - used) != 0) {
+        return -1;
+    }
+    used += flowFieldBytesNeeded(d->bigW, d->bigH);
+    if (pathFinderInit(&travelPath, d->bigW, d->bigH, base + used, bufferSize - used) != 0) {
+        return -1;
+    }
+    used += pathFinderBytesNeeded(d->bigW, d->bigH);
+    if (monstersInit(&monsters, d->bigW, d->bigH, base + used, bufferSize - used) != 0) {
+        return -1;
+    }
+    used += monstersBytesNeeded(d->bigW, d->bigH);
+    return fovInit(&playerFov, d->bigW, d->bigH, base + used, bufferSize - used);
+}
+
+// removing rooms means that there will still be a point there
+// at which corridors can pass through, but there will be
+// no walls, floor, or doors - just corridor
+// Note: only rooms with more than 1 door will be removed
+void removeSomeRooms(Dungeon *d)
+{
+    // Remove a random number between 0 and a third of the cells
+    // (0-3 inclusive on the default 3x3 grid)
+    int roomsToRemove = rngRange(&d->rng, d->gridW * d->gridH / 3 + 1);
+    int cells = d->gridW * d->gridH;
+
+    // Build the candidate list once. Removing a room keeps its corridors,
+    // so no cell's degree changes and the list never needs rescanning
+    int *candidates = d->queue;
+    int count = 0;
+    for (int c = 0; c < cells; c++)
+    {
+        if ((d->graphFlags[c] & MACRO_ROOM) && DEGREE(d, c) >= 2)
+            candidates[count++] = c;
+    }
+
+    // Sample without replacement (partial Fisher-Yates): one draw per
+    // removed room, stopping early if the candidates run out
+    for (int i = 0; i < roomsToRemove && i < count; i++)
+    {
+        int j = i + rngRange(&d->rng, count - i);
+        int c = candidates[j];
+        candidates[j] = candidates[i];
+        candidates[i] = c;
+
+        d->rooms[c] = 0;
+        d->graphFlags[c] = MACRO_NODE;
+        d->stats.roomsRemoved++;
+    }
+}
+
+/**
+ * countWalkable: Number of walkable cells, counted a word at a time from
+ * the packed bitset.
+ */
+long countWalkable(const Dungeon *d)
+{
+    long n = 0;
+    size_t words = (size_t)d->bigH * d->walkWords;
+    for (size_t i = 0; i < words; i++) {
+        n += __builtin_popcountll(d->walkBits[i]);
+    }
+    return n;
+}
+
+/**
+ * computeTileProps: Derives every cell's property flags and the packed
+ * walkable bitset from bigMap. Run once after a level is built; from then
+ * on setCell() keeps them up to date.
+ */
+void computeTileProps(Dungeon *d)
+{
+    for (int y = 0; y < d->bigH; y++) {
+        const unsigned char *row = &TILE(d, 0, y);
+        unsigned char *prow = &PROPS(d, 0, y);
+        uint64_t *wrow = &WALK_WORD(d, 0, y);
+
+        memset(wrow, 0, d->walkWords * sizeof(uint64_t));
+        for (int x = 0; x < d->bigW; x++) {
+            unsigned char tile = row[x];
+            // The player always starts on room floor
+            unsigned char p = tileProps[tile == TILE_PLAYER ? TILE_FLOOR : tile];
+            prow[x] = p;
+            if (p & PROP_WALKABLE) wrow[x >> 6] |= 1ULL << (x & 63);
+        }
+    }
+    d->stats.walkableTiles += (uint64_t)countWalkable(d);
+}
+
+/**
+ * computeTilePropsWords: computeTileProps() gathering each walkable word
+ * in a register, 64 cells at a time without a branch per cell, and
+ * counting it as it is stored; kept as a pass (--passes
+ * computeTilePropsWords) to compare against.
+ */
+void computeTilePropsWords(Dungeon *d)
+{
+    long walkable = 0;
+    for (int y = 0; y < d->bigH; y++) {
+        const unsigned char *row = &TILE(d, 0, y);
+        unsigned char *prow = &PROPS(d, 0, y);
+        uint64_t *wrow = &WALK_WORD(d, 0, y);
+
+        for (int w = 0; w < d->walkWords; w++) {
+            int x0 = w * 64;
+            int x1 = x0 + 64 < d->bigW ? x0 + 64 : d->bigW;
+            uint64_t bits = 0;
+            for (int x = x0; x < x1; x++) {
+                unsigned char p = tileProps[row[x]];
+                prow[x] = p;
+                bits |= (uint64_t)(p & PROP_WALKABLE) << (x - x0);
+            }
+            wrow[w] = bits;
+            walkable += __builtin_popcountll(bits);
+        }
+    }
+
+    // The player always starts on room floor (the table has no entry for it)
+    int px = d->playerX, py = d->playerY;
+    if (px >= 0 && px < d->bigW && py >= 0 && py < d->bigH && TILE(d, px, py) == TILE_PLAYER) {
+        PROPS(d, px, py) = tileProps[TILE_FLOOR];
+        WALK_WORD(d, px, py) |= 1ULL << (px & 63);
+        walkable++;
+    }
+    d->stats.walkableTiles += (uint64_t)walkable;
+}
+
+/*
+ * GenPass: One implementation of a generation stage. Several passes may
+ * register for the same stage; configurePasses() picks which one runs, so
+ * a faster version of a stage can be A/B tested in the same binary
+ * (compare the "pass" timings of two --stats runs).
+ */
+typedef struct {
+    const char *name;       // selects the pass in --passes
+    GenStage stage;         // the pipeline slot it fills
+    void (*run)(Dungeon *d);
+    int required;           // 1 = later stages or walking the level depend on it
+} GenPass;
+
+// Every registered pass. The first STAGE_COUNT entries are the defaults,
+// one per stage in stage order; alternative implementations follow them.
+static const GenPass genPassRegistry[] = {
+    { "generateMaze",                STAGE_GENERATE_MAZE,  generateMaze,                1 },
+    { "buildMacroGraph",             STAGE_BUILD_GRAPH,    buildMacroGraph,             1 },
+    { "removeSomeRooms",             STAGE_REMOVE_ROOMS,   removeSomeRooms,             0 },
+    { "clearBigMap",                 STAGE_CLEAR_MAP,      clearBigMap,                 1 },
+    { "positionRoomsInQuadrants",    STAGE_POSITION_ROOMS, positionRoomsInQuadrants,    1 },
+    { "drawAllRooms",                STAGE_DRAW_ROOMS,     drawAllRooms,                1 },
+    { "drawMissingRoomJunctions",    STAGE_DRAW_JUNCTIONS, drawMissingRoomJunctions,    1 },
+    { "connectNodesWithCorridors",   STAGE_CONNECT_NODES,  connectNodesWithCorridors,   1 },
+    { "placeDoorsForCorridors",      STAGE_PLACE_DOORS,    placeDoorsForCorridors,      1 },
+    { "placePlayerInEdgeRoom",       STAGE_PLACE_PLAYER,   placePlayerInEdgeRoom,       1 },
+    { "placeTreasureInRandomRoom",   STAGE_PLACE_TREASURE, placeTreasureInRandomRoom,   0 },
+    { "placeExitFarthestFromPlayer", STAGE_PLACE_EXIT,     placeExitFarthestFromPlayer, 0 },
+    { "computeTileProps",            STAGE_TILE_PROPS,     computeTileProps,            1 },
+
+    // Alternatives
+    { "clearBigMapCells",            STAGE_CLEAR_MAP,      clearBigMapCells,            1 },
+    { "computeTilePropsWords",       STAGE_TILE_PROPS,     computeTilePropsWords,       1 },
+};
+#define GEN_PASS_COUNT ((int)(sizeof(genPassRegistry) / sizeof(genPassRegistry[0])))
+
+// Changes to the default pipeline, set by configurePasses() before any
+// level is generated and read-only afterwards; all zero runs the defaults
+static const GenPass *genSelected[STAGE_COUNT];     // NULL = the default pass
+static unsigned char genSkipped[STAGE_COUNT];       // 1 = stage disabled
+
+/**
+ * stagePass: The pass stage `s` runs, or NULL if it is disabled.
+ */
+static const GenPass *stagePass(int s)
+{
+    if (genSkipped[s]) return NULL;
+    return genSelected[s] ? genSelected[s] : &genPassRegistry[s];
+}
+
+static const GenPass *findPass(const char *name, size_t len)
+{
+    for (int i = 0; i < GEN_PASS_COUNT; i++) {
+        const char *n = genPassRegistry[i].name;
+        if (strlen(n) == len && strncmp(n, name, len) == 0) return &genPassRegistry[i];
+    }
+    return NULL;
+}
+
+/**
+ * listPasses: Prints the registered passes in pipeline order, marking the
+ * ones the current configuration runs.
+ */
+static void listPasses(FILE *out)
+{
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        for (int i = 0; i < GEN_PASS_COUNT; i++) {
+            const GenPass *p = &genPassRegistry[i];
+            if ((int)p->stage != s) continue;
+            fprintf(out, "%c %s%s\n", stagePass(s) == p ? '*' : ' ',
+                    p->name, p->required ? " (required)" : "");
+        }
+    }
+}
+
+/**
+ * configurePasses: Resets the pipeline to the default pass for every
+ * stage, then applies `spec`, a comma separated list where "name" selects
+ * that pass for its stage and "-name" disables the stage. NULL keeps the
+ * defaults.
+ * @return 0 on success, -1 on an unknown or required pass.
+ */
+int configurePasses(const char *spec)
+{
+    memset(genSelected, 0, sizeof(genSelected));
+    memset(genSkipped, 0, sizeof(genSkipped));
+
+    while (spec && *spec) {
+        size_t len = strcspn(spec, ",");
+        int disable = spec[0] == '-';
+        const GenPass *p = findPass(spec + disable, len - disable);
+        if (!p) {
+            fprintf(stderr, "--passes: unknown pass '%.*s'\n", (int)len, spec);
+            return -1;
+        }
+        if (disable && p->required) {
+            fprintf(stderr, "--passes: %s is required\n", p->name);
+            return -1;
+        }
+        genSelected[p->stage] = disable ? NULL : p;
+        genSkipped[p->stage] = (unsigned char)disable;
+        spec += len;
+        if (*spec == ',') spec++;
+    }
+    return 0;
+}
+
+/**
+ * recordPasses: Stores the pass each stage runs as its genPassRegistry
+ * index in out[STAGE_COUNT], PASS_SKIPPED for a disabled stage.
+ */
+#define PASS_SKIPPED 0xFF
+
+static void recordPasses(unsigned char *out)
+{
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        const GenPass *p = stagePass(s);
+        out[s] = p ? (unsigned char)(p - genPassRegistry) : PASS_SKIPPED;
+    }
+}
+
+/**
+ * restorePasses: Configures the pipeline from what recordPasses() stored.
+ * @return 0 on success, -1 if an entry is out of range, registered for
+ *         another stage, or skips a required stage.
+ */
+static int restorePasses(const unsigned char *in)
+{
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        if (in[s] == PASS_SKIPPED ? genPassRegistry[s].required
+                                  : in[s] >= GEN_PASS_COUNT || (int)genPassRegistry[in[s]].stage != s) {
+            return -1;
+        }
+    }
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        genSkipped[s] = in[s] == PASS_SKIPPED;
+        genSelected[s] = genSkipped[s] ? NULL : &genPassRegistry[in[s]];
+    }
+    return 0;
+}
+
+/**
+ * runPasses: Runs the configured passes for stages `first` to `last`
+ * inclusive, adding each one's duration to d->stats when enabled.
+ */
+static void runPasses(Dungeon *d, GenStage first, GenStage last)
+{
+    for (int s = first; s <= (int)last; s++) {
+        const GenPass *p = stagePass(s);
+        if (!p) continue;
+        if (d->timeStages) {
+            uint64_t t0 = nowNs();
+            p->run(d);
+            d->stats.stageNs[s] += nowNs() - t0;
+        } else {
+            p->run(d);
+        }
+    }
+}
+
+/**
+ * buildTiledMap: Stages 1 and 2 of generateLevel(): the macro layout and
+ * the rooms, junctions, doors and corridors of the tiled map built from it.
+ */
+static void buildTiledMap(Dungeon *d)
+{
+    // 1) The "macro" dungeon layout: generateMaze .. removeSomeRooms
+    // 2) The "tiled" map built from it: clearBigMap .. placeDoorsForCorridors
+    runPasses(d, STAGE_GENERATE_MAZE, STAGE_PLACE_DOORS);
+}
+
+/**
+ * generateLevel: Runs the full generation pipeline into `d`: the macro
+ * layout, the tiled map built from it, then player, treasure and exit.
+ * The same seed, dimensions and pass configuration always produce the
+ * same level.
+ */
+void generateLevel(Dungeon *d, uint64_t seed)
+{
+    d->seed = seed;
+    rngSeed(&d->rng, seed);
+    d->stats.levels++;
+
+    // 1) - 2) Macro layout and tiled map
+    buildTiledMap(d);
+
+    // 3) Place player, treasure, exit (a skipped placement leaves none)
+    // 4) Tile properties for movement/sight queries
+    d->treasureX = d->treasureY = -1;
+    d->exitX = d->exitY = -1;
+    runPasses(d, STAGE_PLACE_PLAYER, STAGE_TILE_PROPS);
+}
+
+/**
+ * addGenStats: Accumulates `src` into `dst`.
+ */
+void addGenStats(GenStats *dst, const GenStats *src)
+{
+    dst->levels += src->levels;
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        dst->stageNs[i] += src->stageNs[i];
+    }
+    dst->cellsWritten  += src->cellsWritten;
+    dst->corridorTiles += src->corridorTiles;
+    dst->roomsRemoved  += src->roomsRemoved;
+    dst->walkableTiles += src->walkableTiles;
+}
+
+/**
+ * writeGenStatsJson: Dumps stage timings and counters as a JSON object.
+ * @return 0 on success, -1 on a write error.
+ */
+int writeGenStatsJson(FILE *out, const GenStats *st)
+{
+    uint64_t totalNs = 0;
+    for (int i = 0; i < STAGE_COUNT; i++) totalNs += st->stageNs[i];
+    double perLevel = st->levels ? 1.0 / st->levels : 0.0;
+
+    fprintf(out, "{\n  \"levels\": %" PRIu64 ",\n", st->levels);
+    fprintf(out, "  \"totalNs\": %" PRIu64 ",\n", totalNs);
+    fprintf(out, "  \"stages\": [\n");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        // The pass that ran the stage, or null if it was disabled
+        const GenPass *p = stagePass(i);
+        const char *pass = p ? p->name : NULL;
+        fprintf(out, "    {\"name\": \"%s\", \"pass\": %s%s%s, \"ns\": %" PRIu64
+                ", \"nsPerLevel\": %.1f}%s\n",
+                genStageNames[i], pass ? "\"" : "", pass ? pass : "null", pass ? "\"" : "",
+                st->stageNs[i], st->stageNs[i] * perLevel, i + 1 < STAGE_COUNT ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"counters\": {\n");
+    fprintf(out, "    \"cellsWritten\": %" PRIu64 ",\n", st->cellsWritten);
+    fprintf(out, "    \"corridorTiles\": %" PRIu64 ",\n", st->corridorTiles);
+    fprintf(out, "    \"roomsRemoved\": %" PRIu64 ",\n", st->roomsRemoved);
+    fprintf(out, "    \"walkableTiles\": %" PRIu64 "\n", st->walkableTiles);
+    fprintf(out, "  }\n}\n");
+    return ferror(out) ? -1 : 0;
+}
+
+/**
+ * dumpGenStats: Writes `st` as JSON to `path` ("-" = stdout).
+ * @return 0 on success, -1 on an I/O error.
+ */
+int dumpGenStats(const char *path, const GenStats *st)
+{
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    int rc = writeGenStatsJson(out, st);
+    if (out != stdout && fclose(out) != 0) rc = -1;
+    if (rc != 0) perror(path);
+    return rc;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Benchmark
+ * ------------------------------------------------------------
+ */
+
+/**
+ * runGenerationBenchmark: Times generateLevel() on square macro grids from
+ * 3x3 up to 256x256 and prints one line per size.
+ * @return 0 on success, -1 if a size does not fit in the buffer.
+ */
+int runGenerationBenchmark(int subgridSize, void *buffer, size_t bufferSize)
+{
+    static const int sizes[] = {3, 4, 8, 16, 32, 64, 128, 256};
+    Dungeon d;
+
+    printf("%-9s %-11s %8s %12s %12s\n", "grid", "tiles", "maps", "ms/map", "Mtiles/s");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int n = sizes[i];
+        if (dungeonInit(&d, n, n, subgridSize, buffer, bufferSize) != 0) {
+            fprintf(stderr, "%dx%d does not fit in the %zu-byte buffer\n", n, n, bufferSize);
+            return -1;
+        }
+
+        // Aim for roughly the same number of tiles generated per size
+        double tiles = (double)d.bigW * d.bigH;
+        int maps = (int)(2.0e7 / tiles);
+        if (maps < 5) maps = 5;
+        if (maps > 20000) maps = 20000;
+
+        double start = nowSeconds();
+        for (int m = 0; m < maps; m++) {
+            generateLevel(&d, (uint64_t)m + 1);
+        }
+        double elapsed = nowSeconds() - start;
+
+        char label[32];
+        snprintf(label, sizeof(label), "%dx%d", n, n);
+        printf("%-9s %-11.0f %8d %12.3f %12.2f\n", label, tiles, maps,
+               elapsed * 1e3 / maps, tiles * maps / elapsed / 1e6);
+    }
+    return 0;
+}
+
+/**
+ * runMonsterBenchmark: Fills a gridW x gridH level with `count`
+ * monsters and times their per-turn update (and, separately, the flow
+ * field update it depends on) while the player wanders at random.
+ * @return 0 on success, -1 if the level does not fit in the buffer.
+ */
+int runMonsterBenchmark(int gridW, int gridH, int subgridSize, int count, uint64_t seed,
+                        void *buffer, size_t bufferSize)
+{
+    static Dungeon d;
+    const int turns = 1000;
+    unsigned char *cursor = buffer;
+    size_t used = dungeonBytesNeeded(gridW, gridH, subgridSize);
+
+    if (dungeonInit(&d, gridW, gridH, subgridSize, buffer, bufferSize) != 0
+        || flowFieldInit(&playerFlow, d.bigW, d.bigH, cursor + used, bufferSize - used) != 0
+        || monstersInit(&monsters, d.bigW, d.bigH,
+                        cursor + used + flowFieldBytesNeeded(d.bigW, d.bigH),
+                        bufferSize - used - flowFieldBytesNeeded(d.bigW, d.bigH)) != 0) {
+        fprintf(stderr, "%dx%d does not fit in the %zu-byte buffer\n",
+                gridW, gridH, bufferSize);
+        return -1;
+    }
+    generateLevel(&d, seed);
+    int placed = monstersSpawn(&monsters, &d, count, MONSTER_SPAWN_DIST, seed);
+
+    Rng rng;
+    rngSeed(&rng, seed);
+    uint64_t flowNs = 0, monsterNs = 0;
+    long hits = 0;
+    for (int t = 0; t < turns; t++) {
+        // The player takes a random step (monsters block it like walls)
+        int k = rngRange(&rng, 4);
+        int nx = d.playerX + flowDX[k], ny = d.playerY + flowDY[k];
+        if (nx >= 0 && nx < d.bigW && ny >= 0 && ny < d.bigH
+            && isWalkable(&d, nx, ny) && monsterAt(&monsters, nx, ny) < 0) {
+            d.playerX = nx;
+            d.playerY = ny;
+        }
+
+        // As far as the field reaches, so every monster is hunting
+        uint64_t t0 = nowNs();
+        flowFieldUpdate(&playerFlow, &d, d.playerX, d.playerY, FLOW_MAX_DIST);
+        uint64_t t1 = nowNs();
+        hits += monstersUpdate(&monsters, &d, &playerFlow);
+        uint64_t t2 = nowNs();
+        flowNs += t1 - t0;
+        monsterNs += t2 - t1;
+    }
+
+    printf("%d monsters on a %dx%d map (%dx%d tiles), %d turns\n",
+           placed, gridW, gridH, d.bigW, d.bigH, turns);
+    printf("  monster update: %8.1f us/turn (%.1f ns per monster)\n",
+           monsterNs / 1e3 / turns, placed ? (double)monsterNs / turns / placed : 0.0);
+    printf("  flow field:     %8.1f us/turn (%ld tiles per search)\n",
+           flowNs / 1e3 / turns, playerFlow.tilesVisited / (playerFlow.updates ? playerFlow.updates : 1));
+    printf("  %ld moves, %ld attacks on the player\n", monsters.moves, hits);
+    return 0;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Level Files
+ * ------------------------------------------------------------
+ *
+ * A level file holds one or more levels of the same dimensions: a
+ * LevelFileHeader followed by `count` fixed-size records. A record is the
+ * level's seed, its entity table (player, treasure, exit), its room table,
+ * the macro room/corridor planes and the tile plane, each at the offset
+ * given in the header and 8-byte aligned. Everything is stored exactly as
+ * the Dungeon holds it in memory (native byte order, see byteOrder), so a
+ * file is loaded by mapping it and pointing a Dungeon's arrays at a
+ * record; nothing is parsed or copied.
+ *
+ * Files whose header says LEVEL_TILES_RLE store the tile plane
+ * run-length encoded instead: a row index of bigH + 1 offsets into the
+ * run bytes, then each row as PackBits-style packets. A control byte
+ * 0x80 + n - 1 repeats the tile after it n times; n - 1 (below 0x80) is
+ * followed by n literal tiles. Any row can still be decoded on its own
+ * through the index. Such records vary in size, and loading one decodes
+ * its tiles into the Dungeon. How much this saves depends on the size of
+ * the level. At the default subgrid of 10, files are about 1.3x smaller
+ * for 3x3 grids and 1.5x for 40x40. Larger subgrids mean longer runs, so
+ * a 3x3 grid shrinks 3.5x at subgrid 23 and 7x at subgrid 40. A 1x1 grid
+ * at subgrid 10 usually grows, because of the row index. saveLevel()
+ * therefore writes raw tiles when RLE would be larger. Batch files choose
+ * their encoding up front, before any level is generated.
+ */
+
+#define LEVEL_FILE_MAGIC "R7LV"
+#define LEVEL_FILE_VERSION 1
+#define LEVEL_BYTE_ORDER 0x01020304u
+#define LEVEL_ENTITIES 3        // player, treasure, exit
+#define RLE_REPEAT 0x80         // control byte flag: a repeated tile, not literals
+#define MAX_RLE_PACKET 128      // tiles one packet covers
+
+// How a level file stores the tile plane (LevelFileHeader.tileEncoding)
+enum {
+    LEVEL_TILES_RAW,        // bigW * bigH bytes, mapped in place
+    LEVEL_TILES_RLE,        // row index plus PackBits-style packets per row
+};
+
+typedef struct {
+    char magic[4];          // LEVEL_FILE_MAGIC
+    uint32_t version;       // LEVEL_FILE_VERSION
+    uint32_t headerBytes;   // sizeof(LevelFileHeader); records start here
+    uint32_t byteOrder;     // LEVEL_BYTE_ORDER as written by this machine
+    uint32_t count;         // number of level records
+    uint32_t gridW, gridH, subgridSize;
+    uint32_t bigW, bigH;
+    uint32_t recordBytes;   // size of one record, a multiple of 8
+    uint32_t entitiesOffset; // offsets of each table within a record
+    uint32_t roomsOffset;
+    uint32_t macroOffset;   // rooms, then horizontal, then vertical corridors
+    uint32_t tilesOffset;
+    uint32_t tileEncoding;  // LEVEL_TILES_RAW or LEVEL_TILES_RLE
+} LevelFileHeader;
+
+// One entry of a record's entity table; x = y = -1 if the entity is absent
+typedef struct {
+    int32_t tile;
+    int32_t x, y;
+} LevelEntity;
+
+_Static_assert(sizeof(LevelFileHeader) == 64, "LevelFileHeader layout");
+_Static_assert(sizeof(TiledRoom) == 5 * sizeof(int32_t), "TiledRoom is stored as-is");
+
+/*
+ * An open level file: the whole file mapped copy-on-write, so the game can
+ * modify a loaded level (moving the player) without touching the file.
+ */
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    const LevelFileHeader *header;
+} LevelFile;
+
+/**
+ * levelFileLayout: Fills in the dimensions, record size and table offsets
+ * of a header for levels of the given size. For LEVEL_TILES_RLE the record
+ * size is an upper bound, allowing two bytes per tile.
+ */
+static void levelFileLayout(LevelFileHeader *h, int gridW, int gridH, int subgridSize,
+                            uint32_t tileEncoding)
+{
+    size_t cells = (size_t)gridW * gridH;
+    size_t tiles = cells * subgridSize * subgridSize;
+    size_t off = sizeof(uint64_t);  // the record starts with the seed
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, LEVEL_FILE_MAGIC, 4);
+    h->version     = LEVEL_FILE_VERSION;
+    h->headerBytes = sizeof(LevelFileHeader);
+    h->byteOrder   = LEVEL_BYTE_ORDER;
+    h->gridW       = gridW;
+    h->gridH       = gridH;
+    h->subgridSize = subgridSize;
+    h->bigW        = gridW * subgridSize;
+    h->bigH        = gridH * subgridSize;
+    h->tileEncoding = tileEncoding;
+
+    h->entitiesOffset = off;
+    off = (off + LEVEL_ENTITIES * sizeof(LevelEntity) + 7) & ~(size_t)7;
+    h->roomsOffset = off;
+    off = (off + cells * sizeof(TiledRoom) + 7) & ~(size_t)7;
+    h->macroOffset = off;
+    off = (off + 3 * cells + 7) & ~(size_t)7;
+    h->tilesOffset = off;
+    if (tileEncoding == LEVEL_TILES_RLE) {
+        off += (h->bigH + 1) * sizeof(uint32_t) + 2 * tiles;
+    } else {
+        off += tiles;
+    }
+    off = (off + 7) & ~(size_t)7;
+    h->recordBytes = off;
+}
+
+/**
+ * levelRecordBytes: Size of the record at `rec`: fixed for raw tiles, for
+ * RLE the row index and runs that follow tilesOffset, padded to 8 bytes.
+ */
+static size_t levelRecordBytes(const LevelFileHeader *h, const unsigned char *rec)
+{
+    if (h->tileEncoding != LEVEL_TILES_RLE) return h->recordBytes;
+    const uint32_t *rowIndex = (const uint32_t *)(rec + h->tilesOffset);
+    size_t bytes = (h->bigH + 1) * sizeof(uint32_t) + rowIndex[h->bigH];
+    return h->tilesOffset + ((bytes + 7) & ~(size_t)7);
+}
+
+/**
+ * rleRunLength: How many of the `max` tiles at `p` repeat p[0], comparing
+ * eight at a time.
+ */
+static int rleRunLength(const unsigned char *p, int max)
+{
+    uint64_t pattern = 0x0101010101010101ULL * p[0];
+    int n = 1;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; n + 8 <= max; n += 8) {
+        uint64_t v;
+        memcpy(&v, p + n, sizeof(v));
+        uint64_t diff = v ^ pattern;
+        if (diff) return n + (__builtin_ctzll(diff) >> 3);
+    }
+#endif
+    while (n < max && p[n] == p[0]) n++;
+    return n;
+}
+
+/**
+ * rleEncodeRow: Encodes `width` tiles as packets into `out`, or only
+ * counts the bytes if `out` is NULL. Runs of three or more tiles become
+ * repeat packets; anything shorter joins a literal packet.
+ * @return the number of bytes the row encodes to.
+ */
+static size_t rleEncodeRow(const unsigned char *row, int width, unsigned char *out)
+{
+    size_t n = 0;
+    int literal = 0;        // tiles waiting for a literal packet, ending at x
+    for (int x = 0; x <= width; ) {
+        int run = 0;
+        if (x < width) {
+            run = rleRunLength(row + x, width - x < MAX_RLE_PACKET ? width - x : MAX_RLE_PACKET);
+        }
+
+        // Flush the pending literals before a repeat, at the end of the
+        // row, or when they fill a packet
+        if (literal > 0 && (run >= 3 || x == width || literal == MAX_RLE_PACKET)) {
+            if (out) {
+                out[n] = (unsigned char)(literal - 1);
+                memcpy(out + n + 1, row + x - literal, (size_t)literal);
+            }
+            n += 1 + literal;
+            literal = 0;
+        }
+        if (x == width) break;
+
+        if (run >= 3) {
+            if (out) {
+                out[n]     = (unsigned char)(RLE_REPEAT + run - 1);
+                out[n + 1] = row[x];
+            }
+            n += 2;
+            x += run;
+        } else {
+            literal++;
+            x++;
+        }
+    }
+    return n;
+}
+
+/**
+ * rleDecodeRow: Expands row `y` of an RLE tile plane into the `width`
+ * tiles at `out`, using the row index to find its packets, or only checks
+ * the packets if `out` is NULL.
+ * @return 0 on success, -1 if the packets do not cover the row exactly.
+ */
+static int rleDecodeRow(const uint32_t *rowIndex, const unsigned char *runs, int y,
+                        unsigned char *out, int width)
+{
+    uint32_t i = rowIndex[y], end = rowIndex[y + 1];
+    int x = 0;
+    while (i < end) {
+        int control = runs[i];
+        int len = (control & (RLE_REPEAT - 1)) + 1;
+        if (len > width - x) return -1;
+        if (control & RLE_REPEAT) {
+            if (end - i < 2 || runs[i + 1] >= TILE_COUNT) return -1;
+            if (out) memset(out + x, runs[i + 1], (size_t)len);
+            i += 2;
+        } else {
+            if (end - i - 1 < (uint32_t)len) return -1;
+            for (int k = 0; k < len; k++) {
+                if (runs[i + 1 + k] >= TILE_COUNT) return -1;
+                if (out) out[x + k] = runs[i + 1 + k];
+            }
+            i += 1 + len;
+        }
+        x += len;
+    }
+    return x == width && i == end ? 0 : -1;
+}
+
+// Zero bytes for padding records out to their table offsets
+static const unsigned char levelPadding[8];
+
+// Row index and one encoded row of the widest possible map. Like textRow,
+// only used by one writer at a time.
+static uint32_t rleRowIndex[MAX_GRID_SIZE * MAX_SUBGRID_SIZE + 1];
+static unsigned char rleRow[2 * MAX_GRID_SIZE * MAX_SUBGRID_SIZE];
+
+/**
+ * writeRleTiles: Appends the tile plane of `d` run-length encoded: the row
+ * index, then every row's runs, then padding to 8 bytes.
+ * @return 0 on success, -1 on a write error.
+ */
+static int writeRleTiles(FILE *out, const Dungeon *d)
+{
+    rleRowIndex[0] = 0;
+    for (int y = 0; y < d->bigH; y++) {
+        rleRowIndex[y + 1] = rleRowIndex[y] + (uint32_t)rleEncodeRow(&TILE(d, 0, y), d->bigW, NULL);
+    }
+    size_t indexBytes = (size_t)(d->bigH + 1) * sizeof(uint32_t);
+    if (fwrite(rleRowIndex, 1, indexBytes, out) != indexBytes) return -1;
+
+    for (int y = 0; y < d->bigH; y++) {
+        size_t n = rleEncodeRow(&TILE(d, 0, y), d->bigW, rleRow);
+        if (fwrite(rleRow, 1, n, out) != n) return -1;
+    }
+    size_t pad = (0 - (indexBytes + rleRowIndex[d->bigH])) & 7;
+    return pad && fwrite(levelPadding, 1, pad, out) != pad ? -1 : 0;
+}
+
+/**
+ * rleTileBytes: Size of the tile plane of `d` run-length encoded: the row
+ * index and every row's runs, before padding.
+ */
+static size_t rleTileBytes(const Dungeon *d)
+{
+    size_t bytes = (size_t)(d->bigH + 1) * sizeof(uint32_t);
+    for (int y = 0; y < d->bigH; y++) {
+        bytes += rleEncodeRow(&TILE(d, 0, y), d->bigW, NULL);
+    }
+    return bytes;
+}
+
+/**
+ * writeLevelFileHeader: Starts a level file for `count` levels with the
+ * dimensions of `d`, storing tiles as `tileEncoding`.
+ * @return 0 on success, -1 on a write error.
+ */
+int writeLevelFileHeader(FILE *out, const Dungeon *d, int count, uint32_t tileEncoding)
+{
+    LevelFileHeader h;
+    levelFileLayout(&h, d->gridW, d->gridH, d->subgridSize, tileEncoding);
+    h.count = count;
+    return fwrite(&h, sizeof(h), 1, out) == 1 ? 0 : -1;
+}
+
+/**
+ * writeLevelRecord: Appends the current level of `d` to a level file as
+ * one record (see levelFileLayout()), its tiles stored as `tileEncoding`.
+ * @return 0 on success, -1 on a write error.
+ */
+int writeLevelRecord(FILE *out, const Dungeon *d, uint32_t tileEncoding)
+{
+    LevelFileHeader h;
+    levelFileLayout(&h, d->gridW, d->gridH, d->subgridSize, tileEncoding);
+    size_t cells = (size_t)d->gridW * d->gridH;
+    size_t tiles = (size_t)d->bigW * d->bigH;
+
+    LevelEntity ents[LEVEL_ENTITIES] = {
+        { TILE_PLAYER,   d->playerX,   d->playerY },
+        { TILE_TREASURE, d->treasureX, d->treasureY },
+        { TILE_EXIT,     d->exitX,     d->exitY },
+    };
+
+    // Each table, then padding up to the next table's offset
+    struct { const void *data; size_t bytes; size_t end; } parts[] = {
+        { &d->seed,                  sizeof(d->seed),           h.entitiesOffset },
+        { ents,                      sizeof(ents),              h.roomsOffset },
+        { d->tiledRooms,             cells * sizeof(TiledRoom), h.macroOffset },
+        { d->rooms,                  cells,                     h.macroOffset + cells },
+        { d->horizontal_corridors,   cells,                     h.macroOffset + 2 * cells },
+        { d->vertical_corridors,     cells,                     h.tilesOffset },
+        { d->bigMap,                 tiles,                     h.recordBytes },
+    };
+    size_t nparts = sizeof(parts) / sizeof(parts[0]);
+    if (tileEncoding == LEVEL_TILES_RLE) nparts--;  // tiles written below
+    size_t pos = 0;
+    for (size_t i = 0; i < nparts; i++) {
+        if (fwrite(parts[i].data, 1, parts[i].bytes, out) != parts[i].bytes) return -1;
+        pos += parts[i].bytes;
+        size_t pad = parts[i].end - pos;
+        if (pad && fwrite(levelPadding, 1, pad, out) != pad) return -1;
+        pos += pad;
+    }
+    return tileEncoding == LEVEL_TILES_RLE ? writeRleTiles(out, d) : 0;
+}
+
+/**
+ * saveLevel: Writes the current level of `d` to `path` as a level file
+ * holding just that level, its tiles stored as `tileEncoding`, or raw if
+ * RLE would not make them smaller.
+ * @return 0 on success, -1 on an I/O error (reported with perror).
+ */
+int saveLevel(const char *path, const Dungeon *d, uint32_t tileEncoding)
+{
+    if (tileEncoding == LEVEL_TILES_RLE && rleTileBytes(d) >= (size_t)d->bigW * d->bigH) {
+        tileEncoding = LEVEL_TILES_RAW;
+    }
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    int failed = writeLevelFileHeader(out, d, 1, tileEncoding) != 0
+              || writeLevelRecord(out, d, tileEncoding) != 0;
+    if (fclose(out) != 0) failed = 1;
+    if (failed) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * levelFileFind: Locates record `index` of an open level file; `count`
+ * locates the end of the last record. Raw records are found by offset; RLE
+ * records vary in size, so those before `index` are stepped over one by
+ * one, checking each lies within the file.
+ * @return the record, or NULL if the file ends first.
+ */
+static unsigned char *levelFileFind(const LevelFile *lf, uint32_t index)
+{
+    const LevelFileHeader *h = lf->header;
+    size_t pos = h->headerBytes;
+
+    if (h->tileEncoding != LEVEL_TILES_RLE) {
+        if ((lf->size - pos) / h->recordBytes < index) return NULL;
+        return lf->base + pos + (size_t)index * h->recordBytes;
+    }
+
+    size_t tiles = (size_t)h->bigW * h->bigH;
+    size_t fixed = h->tilesOffset + (h->bigH + 1) * sizeof(uint32_t);
+    for (uint32_t i = 0; i < index; i++) {
+        if (lf->size - pos < fixed) return NULL;
+        const uint32_t *rowIndex = (const uint32_t *)(lf->base + pos + h->tilesOffset);
+        if (rowIndex[h->bigH] > 2 * tiles) return NULL;
+        size_t bytes = levelRecordBytes(h, lf->base + pos);
+        if (lf->size - pos < bytes) return NULL;
+        pos += bytes;
+    }
+    return lf->base + pos;
+}
+
+/**
+ * levelFileOpen: Maps a level file and checks that its header matches this
+ * build's layout and that the file holds every record it claims to.
+ * @return 0 on success, -1 on failure (reported on stderr).
+ */
+int levelFileOpen(LevelFile *lf, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(LevelFileHeader)) {
+        fprintf(stderr, "%s: not a level file\n", path);
+        close(fd);
+        return -1;
+    }
+
+    // Private and writable: pages the game modifies are copied on write
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    lf->base = base;
+    lf->size = (size_t)st.st_size;
+    lf->header = base;
+
+    const LevelFileHeader *h = lf->header;
+    const char *problem = NULL;
+    LevelFileHeader expect;
+    if (memcmp(h->magic, LEVEL_FILE_MAGIC, 4) != 0) {
+        problem = "not a level file";
+    } else if (h->version != LEVEL_FILE_VERSION) {
+        problem = "unsupported level file version";
+    } else if (h->byteOrder != LEVEL_BYTE_ORDER || h->headerBytes != sizeof(LevelFileHeader)) {
+        problem = "level file written on an incompatible machine";
+    } else if (h->gridW < 1 || h->gridW > MAX_GRID_SIZE || h->gridH < 1 || h->gridH > MAX_GRID_SIZE
+               || h->subgridSize < MIN_SUBGRID_SIZE || h->subgridSize > MAX_SUBGRID_SIZE) {
+        problem = "level dimensions out of range";
+    } else if (h->tileEncoding != LEVEL_TILES_RAW && h->tileEncoding != LEVEL_TILES_RLE) {
+        problem = "unsupported tile encoding";
+    } else {
+        levelFileLayout(&expect, h->gridW, h->gridH, h->subgridSize, h->tileEncoding);
+        expect.count = h->count;
+        if (memcmp(h, &expect, sizeof(expect)) != 0) {
+            problem = "corrupt level file header";
+        } else if (h->count < 1 || levelFileFind(lf, h->count) == NULL) {
+            problem = "truncated level file";
+        }
+    }
+    if (problem) {
+        fprintf(stderr, "%s: %s\n", path, problem);
+        munmap(lf->base, lf->size);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * levelFileClose: Unmaps a level file. Dungeons attached to it must not
+ * be used afterwards.
+ */
+void levelFileClose(LevelFile *lf)
+{
+    munmap(lf->base, lf->size);
+    lf->base = NULL;
+    lf->header = NULL;
+}
+
+/**
+ * levelEntityValid: 1 if a loaded entity is the expected tile and either
+ * absent (-1,-1) or on the map; the player must be present.
+ */
+static int levelEntityValid(const LevelEntity *e, int tile, int optional, const Dungeon *d)
+{
+    if (e->tile != tile) return 0;
+    if (optional && e->x == -1 && e->y == -1) return 1;
+    return e->x >= 0 && e->x < d->bigW && e->y >= 0 && e->y < d->bigH;
+}
+
+/**
+ * levelRoomsValid: 1 if every room of a loaded room table lies inside its
+ * own macro cell.
+ */
+static int levelRoomsValid(const TiledRoom *rooms, const Dungeon *d)
+{
+    for (int gy = 0; gy < d->gridH; gy++) {
+        for (int gx = 0; gx < d->gridW; gx++) {
+            const TiledRoom *r = &rooms[gy * d->gridW + gx];
+            if (r->exists == 0) continue;
+            int left = gx * d->subgridSize, top = gy * d->subgridSize;
+            if (r->exists != 1 || r->width < 1 || r->height < 1
+                || r->x < left || r->width > left + d->subgridSize - r->x
+                || r->y < top || r->height > top + d->subgridSize - r->y) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * levelTilesValid: 1 if all `n` tiles are known tile IDs.
+ */
+static int levelTilesValid(const unsigned char *tiles, size_t n)
+{
+    unsigned char highest = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (tiles[i] > highest) highest = tiles[i];
+    }
+    return highest < TILE_COUNT;
+}
+
+/**
+ * levelFileAttach: Makes record `index` of a level file the current level
+ * of `d`, which must have been set up by dungeonInit() with the file's
+ * dimensions. The room and corridor arrays then point straight into the
+ * mapping, as does the map for raw tiles; RLE tiles are decoded into the
+ * Dungeon's own map. Only the tile properties are rebuilt. The record is
+ * checked first, since a corrupt file must not index past the map or the
+ * tile tables.
+ * @return 0 on success, -1 if the index or dimensions do not match or the
+ *         record's tiles, entities or rooms are out of range.
+ */
+int levelFileAttach(const LevelFile *lf, int index, Dungeon *d)
+{
+    const LevelFileHeader *h = lf->header;
+    if (index < 0 || (uint32_t)index >= h->count) return -1;
+    if ((uint32_t)d->gridW != h->gridW || (uint32_t)d->gridH != h->gridH
+        || (uint32_t)d->subgridSize != h->subgridSize) {
+        return -1;
+    }
+
+    unsigned char *rec = levelFileFind(lf, (uint32_t)index);
+    size_t cells = (size_t)d->gridW * d->gridH;
+    const LevelEntity *ents = (const LevelEntity *)(rec + h->entitiesOffset);
+    TiledRoom *rooms = (TiledRoom *)(rec + h->roomsOffset);
+
+    if (!levelEntityValid(&ents[0], TILE_PLAYER, 0, d)
+        || !levelEntityValid(&ents[1], TILE_TREASURE, 1, d)
+        || !levelEntityValid(&ents[2], TILE_EXIT, 1, d)
+        || !levelRoomsValid(rooms, d)) {
+        return -1;
+    }
+    const uint32_t *rowIndex = (const uint32_t *)(rec + h->tilesOffset);
+    const unsigned char *runs = (const unsigned char *)(rowIndex + h->bigH + 1);
+    if (h->tileEncoding == LEVEL_TILES_RLE) {
+        // Check every row before decoding any, so a bad record leaves the
+        // Dungeon untouched
+        for (int y = 0; y < d->bigH; y++) {
+            if (rowIndex[y + 1] > rowIndex[d->bigH]
+                || rleDecodeRow(rowIndex, runs, y, NULL, d->bigW) != 0) {
+                return -1;
+            }
+        }
+    } else if (!levelTilesValid(rec + h->tilesOffset, (size_t)d->bigW * d->bigH)) {
+        return -1;
+    }
+
+    memcpy(&d->seed, rec, sizeof(d->seed));
+    d->tiledRooms           = rooms;
+    d->rooms                = rec + h->macroOffset;
+    d->horizontal_corridors = rec + h->macroOffset + cells;
+    d->vertical_corridors   = rec + h->macroOffset + 2 * cells;
+    if (h->tileEncoding == LEVEL_TILES_RLE) {
+        for (int y = 0; y < d->bigH; y++) {
+            rleDecodeRow(rowIndex, runs, y, &TILE(d, 0, y), d->bigW);
+        }
+    } else {
+        d->bigMap = rec + h->tilesOffset;
+    }
+    d->playerX   = ents[0].x;
+    d->playerY   = ents[0].y;
+    d->treasureX = ents[1].x;
+    d->treasureY = ents[1].y;
+    d->exitX     = ents[2].x;
+    d->exitY     = ents[2].y;
+
+    buildMacroGraph(d);
+    computeTileProps(d);
+    return 0;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Replays
+ * ------------------------------------------------------------
+ *
+ * A game is fully determined by its settings and the keys pressed, so a
+ * replay file is just those: a ReplayHeader followed by one byte per key.
+ * Playing it back runs the keys through gameHandleKey() without ncurses,
+ * as fast as they go.
+ */
+
+#define REPLAY_MAGIC "R7RP"
+#define REPLAY_VERSION 3
+#define REPLAY_STAGES 16        // room for STAGE_COUNT entries in ReplayHeader
+#define MAX_REPLAY_KEYS (1 << 20)
+
+typedef struct {
+    char magic[4];          // REPLAY_MAGIC
+    uint32_t version;       // REPLAY_VERSION
+    uint64_t seed;          // seed of the first level
+    uint32_t gridW, gridH, subgridSize;
+    uint32_t levelCount;
+    uint32_t monstersPerLevel;
+    uint32_t keyCount;      // key bytes following the header
+    uint32_t fogOfWar;      // 0 = recorded with --reveal (T / E travel anywhere)
+    uint32_t reserved;      // zero
+    unsigned char passes[REPLAY_STAGES];    // see recordPasses(); the rest zero
+} ReplayHeader;
+
+_Static_assert(sizeof(ReplayHeader) == 64, "ReplayHeader layout");
+_Static_assert(STAGE_COUNT <= REPLAY_STAGES, "ReplayHeader has no room for every stage");
+
+// Keys of the game being recorded, or of the replay being played back
+static unsigned char replayKeys[MAX_REPLAY_KEYS];
+
+/**
+ * saveReplay: Writes the settings of game `g` (whose first level was
+ * generated from `seed`) and the keys it recorded to `path`.
+ * @return 0 on success, -1 on error (reported on stderr).
+ */
+int saveReplay(const char *path, const Game *g, uint64_t seed)
+{
+    const Dungeon *d = g->levels[0];
+    ReplayHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, REPLAY_MAGIC, 4);
+    h.version = REPLAY_VERSION;
+    h.seed = seed;
+    h.gridW = (uint32_t)d->gridW;
+    h.gridH = (uint32_t)d->gridH;
+    h.subgridSize = (uint32_t)d->subgridSize;
+    h.levelCount = (uint32_t)g->levelCount;
+    h.monstersPerLevel = (uint32_t)monstersPerLevel;
+    h.keyCount = (uint32_t)g->keyCount;
+    h.fogOfWar = (uint32_t)fogOfWar;
+    recordPasses(h.passes);
+
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    int failed = fwrite(&h, sizeof(h), 1, out) != 1
+                 || fwrite(g->keys, 1, (size_t)g->keyCount, out) != (size_t)g->keyCount;
+    if (fclose(out) != 0) failed = 1;
+    if (failed) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * loadReplay: Reads a replay file's header into *h and its keys into
+ * replayKeys.
+ * @return 0 on success, -1 on error (reported on stderr).
+ */
+int loadReplay(const char *path, ReplayHeader *h)
+{
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+    int ok = fread(h, sizeof(*h), 1, in) == 1
+             && memcmp(h->magic, REPLAY_MAGIC, 4) == 0
+             && h->version == REPLAY_VERSION
+             && h->keyCount <= MAX_REPLAY_KEYS
+             && fread(replayKeys, 1, h->keyCount, in) == h->keyCount;
+    fclose(in);
+    if (!ok) {
+        fprintf(stderr, "%s: not a replay file (or truncated)\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * runReplay: Plays a replay file back without ncurses and reports how
+ * the game ended and how many turns per second were played. Levels are
+ * generated with the passes the game was recorded with; `passesGiven`
+ * (--passes was on the command line) must then select the same ones.
+ * @return 0 on success, -1 on error.
+ */
+int runReplay(const char *path, int passesGiven, void *buffer, size_t bufferSize)
+{
+    static Dungeon dungeon, spare;
+    static Pregen pregen;
+    static Game game;
+    Dungeon *levels[2] = { &dungeon, &spare };
+    ReplayHeader h;
+
+    if (loadReplay(path, &h) != 0) return -1;
+    if (h.levelCount < 1
+        || gameBuffersInit(levels, (int)h.gridW, (int)h.gridH, (int)h.subgridSize,
+                           (int)h.levelCount, buffer, bufferSize) != 0) {
+        fprintf(stderr, "%s: unsupported dungeon size %ux%u with subgrid %u\n",
+                path, h.gridW, h.gridH, h.subgridSize);
+        return -1;
+    }
+    unsigned char current[REPLAY_STAGES] = { 0 };
+    recordPasses(current);
+    if (passesGiven && memcmp(current, h.passes, sizeof(current)) != 0) {
+        fprintf(stderr, "%s: recorded with other generation passes than --passes selects\n", path);
+        return -1;
+    }
+    if (restorePasses(h.passes) != 0) {
+        fprintf(stderr, "%s: recorded with generation passes this build does not have\n", path);
+        return -1;
+    }
+    monstersPerLevel = (int)h.monstersPerLevel;
+    fogOfWar = h.fogOfWar != 0;
+
+    uint64_t t0 = nowNs();
+    generateLevel(levels[0], h.seed);
+    gameStart(&game, levels, (int)h.levelCount, &pregen);
+    int ev = GAME_IGNORED;
+    uint32_t k = 0;
+    while (gameRunning && k < h.keyCount) {
+        ev = gameHandleKey(&game, replayKeys[k++]);
+    }
+    pregenCancel(&pregen);
+    double seconds = (nowNs() - t0) / 1e9;
+
+    const Dungeon *d = game.levels[0];
+    const char *outcome = ev == GAME_DIED    ? "killed by a monster"
+                        : ev == GAME_ESCAPED ? "escaped the dungeon"
+                        : ev == GAME_QUIT    ? "quit"
+                        : "still playing when the keys ran out";
+    printf("%s: seed %" PRIu64 ", %ux%u grid, subgrid %u, %u level(s), %u monsters per level%s\n",
+           path, h.seed, h.gridW, h.gridH, h.subgridSize, h.levelCount, h.monstersPerLevel,
+           h.fogOfWar ? "" : ", revealed");
+    printf("Played %u of %u keys: %ld turns in %.3f ms (%.0f turns/second)\n",
+           k, h.keyCount, turnCount, seconds * 1e3, seconds > 0 ? turnCount / seconds : 0.0);
+    printf("Outcome: %s on level %d at (%d,%d), HP %d, %s\n",
+           outcome, currentDepth, d->playerX, d->playerY, playerHp,
+           hasTreasure ? "with the treasure" : "without the treasure");
+    return 0;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Bots
+ * ------------------------------------------------------------
+ *
+ * Scripted players for load testing the game core: each bot picks one
+ * key per turn and feeds it to gameHandleKey(), exactly like the ncurses
+ * loop does, only without drawing. The random bot walks at random; the
+ * greedy bot walks a shortest path to the treasure, then to the exit.
+ */
+
+#define BOT_MAX_KEYS 5000       // a game not won or lost by then times out
+
+enum { BOT_RANDOM, BOT_GREEDY, BOT_COUNT };
+static const char *botNames[BOT_COUNT] = { "random", "greedy" };
+
+// Movement keys, indexed like flowDX / flowDY
+static const char botMoveKeys[4] = { 'w', 's', 'a', 'd' };
+
+typedef struct {
+    int kind;                   // BOT_*
+    Rng rng;
+
+    // Greedy bot: the path being followed (in travelPath.steps) and
+    // where the player should be when the next step is taken
+    const Dungeon *level;
+    int targetX, targetY;
+    int expectX, expectY;
+    int steps, next;
+} Bot;
+
+/**
+ * botKey: The key bot `b` presses next in game `g`.
+ */
+static int botKey(Bot *b, const Game *g)
+{
+    const Dungeon *d = g->levels[0];
+    if (b->kind == BOT_RANDOM) return botMoveKeys[rngRange(&b->rng, 4)];
+
+    int tx = d->exitX, ty = d->exitY;
+    if (!hasTreasure && d->treasureX >= 0) {
+        tx = d->treasureX;
+        ty = d->treasureY;
+    }
+
+    // Plan again after anything unexpected: a new level or target, or a
+    // step that did not happen (the player attacked instead)
+    if (b->level != d || b->targetX != tx || b->targetY != ty || b->next >= b->steps
+        || d->playerX != b->expectX || d->playerY != b->expectY) {
+        b->level = d;
+        b->targetX = tx;
+        b->targetY = ty;
+        b->steps = pathFind(&travelPath, d, d->playerX, d->playerY, tx, ty);
+        b->next = 0;
+        if (b->steps <= 0) return botMoveKeys[rngRange(&b->rng, 4)];
+    }
+    int k = travelPath.steps[b->next++];
+    b->expectX = d->playerX + flowDX[k];
+    b->expectY = d->playerY + flowDY[k];
+    return botMoveKeys[k];
+}
+
+/**
+ * runBots: Plays `games` games (consecutive seeds from `seed`) with each
+ * kind of bot, without ncurses, and reports win rates and turns/second.
+ * @return 0 on success, -1 if the levels do not fit in the buffer.
+ */
+int runBots(int gridW, int gridH, int subgridSize, int levelCount, int games,
+            uint64_t seed, void *buffer, size_t bufferSize)
+{
+    static Dungeon dungeon, spare;
+    static Pregen pregen;
+    static Game game;
+    Dungeon *levels[2] = { &dungeon, &spare };
+
+    if (gameBuffersInit(levels, gridW, gridH, subgridSize, levelCount,
+                        buffer, bufferSize) != 0) {
+        fprintf(stderr, "Unsupported dungeon size %dx%d with subgrid %d\n",
+                gridW, gridH, subgridSize);
+        return -1;
+    }
+
+    printf("%d games per bot on %dx%d grids, subgrid %d, %d level(s), %d monsters per level\n",
+           games, gridW, gridH, subgridSize, levelCount, monstersPerLevel);
+    printf("%-8s %8s %8s %8s %9s %12s %12s\n",
+           "bot", "wins", "deaths", "timeouts", "win rate", "turns", "turns/sec");
+
+    for (int kind = 0; kind < BOT_COUNT; kind++) {
+        int wins = 0, deaths = 0, timeouts = 0;
+        long turns = 0;
+        uint64_t ns = 0;
+
+        for (int i = 0; i < games; i++) {
+            uint64_t gameSeed = seed + (uint64_t)i;
+            Bot bot;
+            memset(&bot, 0, sizeof(bot));
+            bot.kind = kind;
+            rngSeed(&bot.rng, gameSeed);
+
+            generateLevel(levels[0], gameSeed);
+            uint64_t t0 = nowNs();
+            gameStart(&game, levels, levelCount, &pregen);
+            int ev = GAME_IGNORED;
+            for (int k = 0; k < BOT_MAX_KEYS && gameRunning; k++) {
+                ev = gameHandleKey(&game, botKey(&bot, &game));
+            }
+            pregenCancel(&pregen);
+            ns += nowNs() - t0;
+
+            turns += turnCount;
+            if (ev == GAME_ESCAPED) wins++;
+            else if (ev == GAME_DIED) deaths++;
+            else timeouts++;
+            // Descents swap the buffers; both are still ours
+            levels[0] = game.levels[0];
+            levels[1] = game.levels[1];
+        }
+        printf("%-8s %8d %8d %8d %8.1f%% %12ld %12.0f\n",
+               botNames[kind], wins, deaths, timeouts, games ? 100.0 * wins / games : 0.0,
+               turns, ns ? turns / (ns / 1e9) : 0.0);
+    }
+    return 0;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Headless Batch Generation
+ * ------------------------------------------------------------
+ */
+
+// One text row of the widest possible map: up to 3 UTF-8 bytes per tile plus "\n"
+static char textRow[MAX_GRID_SIZE * MAX_SUBGRID_SIZE * 3 + 2];
+
+/**
+ * writeLevelText: Writes a level as a "# seed ..." header line followed by
+ * one line of glyphs per map row and a blank separator line.
+ * @return 0 on success, -1 on a write error.
+ */
+int writeLevelText(FILE *out, const Dungeon *d)
+{
+    fprintf(out, "# seed %" PRIu64 " grid %dx%d subgrid %d\n",
+            d->seed, d->gridW, d->gridH, d->subgridSize);
+
+    for (int y = 0; y < d->bigH; y++) {
+        size_t len = 0;
+        for (int x = 0; x < d->bigW; x++) {
+            const char *g = tileGlyphs[TILE(d, x, y)];
+            while (*g) textRow[len++] = *g++;
+        }
+        textRow[len++] = '\n';
+        if (fwrite(textRow, 1, len, out) != len) return -1;
+    }
+    return fputc('\n', out) == EOF ? -1 : 0;
+}
+
+// How --generate writes levels to --out
+typedef enum {
+    LEVEL_FORMAT_TEXT,      // writeLevelText()
+    LEVEL_FORMAT_BINARY,    // a level file, see writeLevelRecord()
+    LEVEL_FORMAT_RLE,       // a level file with run-length encoded tiles
+} LevelFormat;
+
+// The level file tile encoding a binary LevelFormat writes
+#define LEVEL_FORMAT_TILES(f) ((f) == LEVEL_FORMAT_RLE ? LEVEL_TILES_RLE : LEVEL_TILES_RAW)
+
+/*
+ * State shared by the batch generation workers. Workers claim level
+ * indices from nextLevel; levels are written in seed order: a worker waits
+ * for nextToWrite to reach its level index before writing, which also
+ * serializes use of textRow.
+ */
+typedef struct {
+    int count;
+    uint64_t firstSeed;
+    atomic_int nextLevel;
+    FILE *out;
+    LevelFormat format;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    int nextToWrite;
+    int failed;
+} BatchShared;
+
+/*
+ * One batch generation worker. Each builds levels into its own Dungeon,
+ * so workers never share generator state. Cache-line aligned so that
+ * neighbouring workers' RNG state doesn't false-share.
+ */
+typedef struct {
+    _Alignas(64) Dungeon d;
+    BatchShared *shared;
+    double genSeconds;      // time spent inside generateLevel()
+} BatchWorker;
+
+static void *batchWorkerMain(void *arg)
+{
+    BatchWorker *w = arg;
+    BatchShared *sh = w->shared;
+
+    for (;;) {
+        int i = atomic_fetch_add(&sh->nextLevel, 1);
+        if (i >= sh->count) break;
+
+        double t0 = nowSeconds();
+        generateLevel(&w->d, sh->firstSeed + (uint64_t)i);
+        w->genSeconds += nowSeconds() - t0;
+
+        if (!sh->out) continue;
+
+        pthread_mutex_lock(&sh->lock);
+        while (sh->nextToWrite != i) {
+            pthread_cond_wait(&sh->turn, &sh->lock);
+        }
+        if (!sh->failed) {
+            int err = (sh->format != LEVEL_FORMAT_TEXT)
+                    ? writeLevelRecord(sh->out, &w->d, LEVEL_FORMAT_TILES(sh->format))
+                    : writeLevelText(sh->out, &w->d);
+            if (err != 0) sh->failed = 1;
+        }
+        sh->nextToWrite++;
+        pthread_cond_broadcast(&sh->turn);
+        pthread_mutex_unlock(&sh->lock);
+    }
+    return NULL;
+}
+
+/**
+ * runBatchGeneration: Generates `count` gridW x gridH levels without
+ * ncurses, using seeds firstSeed, firstSeed+1, ..., spread over `threads`
+ * workers that each get an equal slice of `buffer`. Optionally writes each
+ * level to `outPath` (NULL = generate only) in seed order, so the output
+ * does not depend on the thread count; `format` picks text or a binary
+ * level file. Reports throughput on stdout, and
+ * if `statsPath` is set, dumps the workers' combined GenStats there.
+ * @return 0 on success, -1 on a size or I/O error.
+ */
+int runBatchGeneration(int gridW, int gridH, int subgridSize, int count,
+                       uint64_t firstSeed, const char *outPath, LevelFormat format,
+                       const char *statsPath, int threads, void *buffer, size_t bufferSize)
+{
+    static BatchWorker workers[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    BatchShared shared = { count, firstSeed, 0, NULL, format,
+                           PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (threads > count) threads = count;
+    if (count < 1) return 0;
+
+    // Give each worker an equal, 8-byte aligned slice of the buffer
+    size_t slice = (bufferSize / threads) & ~(size_t)7;
+    for (int t = 0; t < threads; t++) {
+        BatchWorker *w = &workers[t];
+        if (dungeonInit(&w->d, gridW, gridH, subgridSize,
+                        (unsigned char *)buffer + t * slice, slice) != 0) {
+            fprintf(stderr, "%dx%d levels (subgrid %d) do not fit %d per buffer\n",
+                    gridW, gridH, subgridSize, threads);
+            return -1;
+        }
+        w->d.timeStages = statsPath != NULL;
+        w->shared     = &shared;
+        w->genSeconds = 0.0;
+    }
+
+    if (outPath) {
+        shared.out = fopen(outPath, "wb");
+        if (!shared.out) {
+            perror(outPath);
+            return -1;
+        }
+        if (format != LEVEL_FORMAT_TEXT
+            && writeLevelFileHeader(shared.out, &workers[0].d, count,
+                                    LEVEL_FORMAT_TILES(format)) != 0) {
+            shared.failed = 1;
+        }
+    }
+
+    // The calling thread acts as worker 0. If a thread fails to start, the
+    // running workers simply claim its share of the levels.
+    double start = nowSeconds();
+    int started = 0;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, batchWorkerMain, &workers[t]) != 0) break;
+        started = t;
+    }
+    threads = started + 1;
+    batchWorkerMain(&workers[0]);
+    for (int t = 1; t <= started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    double total = nowSeconds() - start;
+
+    if (shared.out && fclose(shared.out) != 0) shared.failed = 1;
+    if (shared.failed) {
+        perror(outPath);
+        return -1;
+    }
+
+    double genSeconds = 0.0;
+    for (int t = 0; t < threads; t++) genSeconds += workers[t].genSeconds;
+
+    printf("generated %d %dx%d maps (seeds %" PRIu64 "-%" PRIu64 ") on %d thread%s in %.3f s\n",
+           count, gridW, gridH, firstSeed, firstSeed + (uint64_t)count - 1,
+           threads, threads == 1 ? "" : "s", total);
+    printf("  generation only: %.1f maps/s per thread\n", genSeconds > 0 ? count / genSeconds : 0.0);
+    printf("  overall: %.1f maps/s\n", total > 0 ? count / total : 0.0);
+
+    if (statsPath) {
+        GenStats all;
+        memset(&all, 0, sizeof(all));
+        for (int t = 0; t < threads; t++) addGenStats(&all, &workers[t].d.stats);
+        if (dumpGenStats(statsPath, &all) != 0) return -1;
+    }
+    return 0;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Level Validation
+ * ------------------------------------------------------------
+ *
+ * validateLevel() checks a generated level for the mistakes the
+ * generator can make: entities overwritten or unreachable, the exit in
+ * the player's room, doors that are not in a wall, and corridors cut
+ * through rooms. Reachability is a flood fill over walkBits, one 64-tile
+ * word at a time, so a level costs a few passes over its bitset rows.
+ * --validate runs it over a range of seeds on every core.
+ */
+
+enum {
+    CHECK_PLAYER,           // "@" missing from the player's position
+    CHECK_TREASURE,         // "T" missing from the treasure's position
+    CHECK_EXIT,             // "E" missing from the exit's position
+    CHECK_EXIT_ROOM,        // exit in the player's room
+    CHECK_REACH_TREASURE,   // no walk from "@" to "T"
+    CHECK_REACH_EXIT,       // no walk from "@" to "E"
+    CHECK_DOOR,             // a door not between two wall tiles
+    CHECK_CORRIDOR,         // a corridor (or gap) inside a room or its walls
+    CHECK_COUNT
+};
+
+static const char *checkNames[CHECK_COUNT] = {
+    [CHECK_PLAYER]         = "player missing",
+    [CHECK_TREASURE]       = "treasure missing",
+    [CHECK_EXIT]           = "exit missing",
+    [CHECK_EXIT_ROOM]      = "exit in player's room",
+    [CHECK_REACH_TREASURE] = "treasure unreachable",
+    [CHECK_REACH_EXIT]     = "exit unreachable",
+    [CHECK_DOOR]           = "door not in a wall",
+    [CHECK_CORRIDOR]       = "corridor through a room",
+};
+
+/**
+ * validateBytesNeeded: How large a scratch buffer validateLevel() needs.
+ */
+size_t validateBytesNeeded(const Dungeon *d)
+{
+    // Per bitset word: the reached bits, a stack slot and a queued flag
+    size_t n = (size_t)d->walkWords * d->bigH;
+    return n * (sizeof(uint64_t) + sizeof(int) + 1);
+}
+
+/**
+ * fillHigh / fillLow: Spread the bits of `s` through the runs of set bits
+ * of `m` they sit in, towards bit 63 / bit 0 (an occluded fill: six
+ * shift-and-mask steps instead of one step per tile).
+ */
+static uint64_t fillHigh(uint64_t s, uint64_t m)
+{
+    s &= m;
+    s |= m & (s << 1);  m &= m << 1;
+    s |= m & (s << 2);  m &= m << 2;
+    s |= m & (s << 4);  m &= m << 4;
+    s |= m & (s << 8);  m &= m << 8;
+    s |= m & (s << 16); m &= m << 16;
+    s |= m & (s << 32);
+    return s;
+}
+
+static uint64_t fillLow(uint64_t s, uint64_t m)
+{
+    s &= m;
+    s |= m & (s >> 1);  m &= m >> 1;
+    s |= m & (s >> 2);  m &= m >> 2;
+    s |= m & (s >> 4);  m &= m >> 4;
+    s |= m & (s >> 8);  m &= m >> 8;
+    s |= m & (s >> 16); m &= m >> 16;
+    s |= m & (s >> 32);
+    return s;
+}
+
+/**
+ * floodFromPlayer: Marks in `reach` every tile the player can walk to;
+ * `stack` and `queued` are scratch with one entry per bitset word.
+ *
+ * The unit of work is one 64-tile word of one row. A word takes the
+ * reached bits it can step into from the words above and below it and
+ * from the edge bits of its left and right neighbours, and spreads them
+ * along its own walkable runs. Whenever a word gains tiles, the words
+ * around it are queued to look again.
+ */
+static void floodFromPlayer(const Dungeon *d, uint64_t *reach, int *stack,
+                            unsigned char *queued)
+{
+    int words = d->walkWords;
+    int h = d->bigH;
+    size_t n = (size_t)words * h;
+    size_t player = (size_t)d->playerY * words + (d->playerX >> 6);
+    uint64_t playerBit = 1ULL << (d->playerX & 63);
+    int top = 0;
+    int start = 1;
+
+    memset(reach, 0, n * sizeof(uint64_t));
+    memset(queued, 0, n);
+    reach[player] = playerBit;
+    stack[top++] = (int)player;
+    queued[player] = 1;
+
+    while (top > 0) {
+        int w = stack[--top];
+        queued[w] = 0;
+        int y = w / words, i = w % words;
+
+        // The player's own tile holds "@", which is not walkable
+        uint64_t m = d->walkBits[w] | ((size_t)w == player ? playerBit : 0);
+        uint64_t r = reach[w];
+        uint64_t in = r;
+        if (y > 0) in |= reach[w - words];
+        if (y < h - 1) in |= reach[w + words];
+        if (i > 0) in |= reach[w - 1] >> 63;
+        if (i < words - 1) in |= reach[w + 1] << 63;
+        in &= m;
+        if ((in & ~r) == 0 && !start) continue;
+        start = 0;
+
+        reach[w] = r = fillLow(fillHigh(in, m), m);
+
+        // Neighbours that may now be able to take something from us
+        int next[4], count = 0;
+        if (y > 0) next[count++] = w - words;
+        if (y < h - 1) next[count++] = w + words;
+        if (i > 0 && (r & 1)) next[count++] = w - 1;
+        if (i < words - 1 && (r >> 63)) next[count++] = w + 1;
+        for (int k = 0; k < count; k++) {
+            if (!queued[next[k]]) {
+                queued[next[k]] = 1;
+                stack[top++] = next[k];
+            }
+        }
+    }
+}
+
+/**
+ * isWallTile: Whether a tile is part of a room's wall (doors included).
+ */
+static int isWallTile(unsigned char t)
+{
+    return t == TILE_WALL_H || t == TILE_WALL_V || t == TILE_DOOR
+        || (t >= TILE_CORNER_TL && t <= TILE_CORNER_BR);
+}
+
+/**
+ * validateLevel: Checks a generated level; `scratch` must hold
+ * validateBytesNeeded(d) bytes.
+ * @return A bit mask of the CHECK_* checks that failed, 0 = valid.
+ */
+unsigned validateLevel(const Dungeon *d, uint64_t *scratch)
+{
+    unsigned failed = 0;
+    int hasT = d->treasureX >= 0;
+    int hasE = d->exitX >= 0;      // none when placement was skipped (--passes)
+
+    // Entities where the level says they are
+    if (TILE(d, d->playerX, d->playerY) != TILE_PLAYER) failed |= 1u << CHECK_PLAYER;
+    if (hasT && TILE(d, d->treasureX, d->treasureY) != TILE_TREASURE) {
+        failed |= 1u << CHECK_TREASURE;
+    }
+    if (hasE && TILE(d, d->exitX, d->exitY) != TILE_EXIT) failed |= 1u << CHECK_EXIT;
+
+    // Reachability
+    size_t n = (size_t)d->walkWords * d->bigH;
+    int *stack = (int *)(scratch + n);
+    floodFromPlayer(d, scratch, stack, (unsigned char *)(stack + n));
+#define REACHED(x, y) ((scratch[(size_t)(y) * d->walkWords + ((x) >> 6)] >> ((x) & 63)) & 1)
+    if (hasT && !REACHED(d->treasureX, d->treasureY)) failed |= 1u << CHECK_REACH_TREASURE;
+    if (hasE && !REACHED(d->exitX, d->exitY)) failed |= 1u << CHECK_REACH_EXIT;
+#undef REACHED
+
+    // Rooms: walls intact, nothing but room tiles inside
+    for (int i = 0; i < d->gridW * d->gridH; i++) {
+        const TiledRoom *r = &d->tiledRooms[i];
+        if (!r->exists) continue;
+        int x1 = r->x + r->width - 1, y1 = r->y + r->height - 1;
+        if (d->playerX >= r->x && d->playerX <= x1 && d->playerY >= r->y && d->playerY <= y1
+            && d->exitX >= r->x && d->exitX <= x1 && d->exitY >= r->y && d->exitY <= y1) {
+            failed |= 1u << CHECK_EXIT_ROOM;
+        }
+        for (int y = r->y; y <= y1; y++) {
+            for (int x = r->x; x <= x1; x++) {
+                int edge = (x == r->x || x == x1 || y == r->y || y == y1);
+                unsigned char t = TILE(d, x, y);
+                if (edge ? !isWallTile(t) : !(PROPS(d, x, y) & PROP_ROOM) && t != TILE_PLAYER) {
+                    failed |= 1u << CHECK_CORRIDOR;
+                }
+            }
         }
+    }
 
-        int newX = playerX;
-        int newY = playerY;
+    // Doors: wall on both sides along one axis
+    for (int y = 0; y < d->bigH; y++) {
+        for (int x = 0; x < d->bigW; x++) {
+            if (TILE(d, x, y) != TILE_DOOR) continue;
+            int horiz = x > 0 && x < d->bigW - 1
+                        && isWallTile(TILE(d, x - 1, y)) && isWallTile(TILE(d, x + 1, y));
+            int vert = y > 0 && y < d->bigH - 1
+                       && isWallTile(TILE(d, x, y - 1)) && isWallTile(TILE(d, x, y + 1));
+            if (!horiz && !vert) failed |= 1u << CHECK_DOOR;
+        }
+    }
+    return failed;
+}
 
-        if (ch == 'w' || ch == 'W') newY--;
-        if (ch == 's' || ch == 'S') newY++;
-        if (ch == 'a' || ch == 'A') newX--;
-        if (ch == 'd' || ch == 'D') newX++;
+#define VALIDATE_EXAMPLES 8     // failing seeds listed per run
 
-        // Bounds check
-        if (newX < 0 || newX >= BIG_SIZE || newY < 0 || newY >= BIG_SIZE) {
-            continue;
+/*
+ * One validation worker: its own Dungeon and flood fill scratch, its own
+ * failure counts, and the first failing seeds it met.
+ */
+typedef struct {
+    _Alignas(64) Dungeon d;
+    uint64_t *scratch;
+    atomic_int *next;
+    int count;
+    uint64_t firstSeed;
+    long failures[CHECK_COUNT];
+    long badLevels;
+    int exampleCount;
+    uint64_t examples[VALIDATE_EXAMPLES];
+    unsigned exampleChecks[VALIDATE_EXAMPLES];
+} ValidateWorker;
+
+// Levels claimed per atomic_fetch_add: validation is fast enough that
+// claiming one at a time would make the counter the bottleneck
+#define VALIDATE_CHUNK 256
+
+static void *validateWorkerMain(void *arg)
+{
+    ValidateWorker *w = arg;
+
+    for (;;) {
+        int first = atomic_fetch_add(w->next, VALIDATE_CHUNK);
+        if (first >= w->count) break;
+        int last = first + VALIDATE_CHUNK < w->count ? first + VALIDATE_CHUNK : w->count;
+
+        for (int i = first; i < last; i++) {
+            uint64_t seed = w->firstSeed + (uint64_t)i;
+            generateLevel(&w->d, seed);
+            unsigned failed = validateLevel(&w->d, w->scratch);
+            if (!failed) continue;
+
+            w->badLevels++;
+            for (int c = 0; c < CHECK_COUNT; c++) {
+                if (failed & (1u << c)) w->failures[c]++;
+            }
+            if (w->exampleCount < VALIDATE_EXAMPLES) {
+                w->examples[w->exampleCount] = seed;
+                w->exampleChecks[w->exampleCount++] = failed;
+            }
         }
+    }
+    return NULL;
+}
 
-        // Check if walkable
-        if (!isWalkable(bigMap[newY][newX])) {
-            continue;
+/**
+ * runValidation: Generates and validates `count` levels (seeds firstSeed,
+ * firstSeed+1, ...) on `threads` workers and reports how many failed each
+ * check, with a few failing seeds.
+ * @return 0 if every level is valid, 1 if some are not, -1 on a size error.
+ */
+int runValidation(int gridW, int gridH, int subgridSize, int count, uint64_t firstSeed,
+                  int threads, void *buffer, size_t bufferSize)
+{
+    static ValidateWorker workers[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    atomic_int next = 0;
+
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (count < 1) return 0;
+
+    // Each worker's slice of the buffer holds its Dungeon, then its scratch
+    size_t slice = (bufferSize / threads) & ~(size_t)7;
+    for (int t = 0; t < threads; t++) {
+        ValidateWorker *w = &workers[t];
+        unsigned char *base = (unsigned char *)buffer + t * slice;
+        size_t used = dungeonBytesNeeded(gridW, gridH, subgridSize);
+        if (dungeonInit(&w->d, gridW, gridH, subgridSize, base, slice) != 0
+            || used + validateBytesNeeded(&w->d) > slice) {
+            fprintf(stderr, "%dx%d levels (subgrid %d) do not fit %d per buffer\n",
+                    gridW, gridH, subgridSize, threads);
+            return -1;
         }
+        memset(w->failures, 0, sizeof(w->failures));
+        w->scratch = (uint64_t *)(base + used);
+        w->next = &next;
+        w->count = count;
+        w->firstSeed = firstSeed;
+        w->badLevels = 0;
+        w->exampleCount = 0;
+    }
 
-        // ---------------------------------------
-        // 1) Restore the old tile
-        //    (The tile that was under the player, saved in prevTile)
-        // ---------------------------------------
-        setCell(playerX, playerY, prevTile);
-
-        // ---------------------------------------
-        // 2) Figure out what tile is currently at newX,newY
-        //    Save it to prevTile for the next iteration
-        // ---------------------------------------
-        strcpy(prevTile, bigMap[newY][newX]);
-        
-        // If that tile is "T" or "E", we might handle it differently:
-        if (strncmp(prevTile, "T", 4) == 0) {
-            hasTreasure = 1;
-            // The treasure is "picked up," so the tile effectively becomes ".".
-            strncpy(prevTile, ".", 4);
-            mvprintw(BIG_SIZE+1, 0, "You got the treasure!");
-        }
-        else if (strncmp(prevTile, "E", 4) == 0) {
-            if (!hasTreasure) {
-                mvprintw(BIG_SIZE+1, 0, "You found the exit... but no treasure!");
-            } else {
-                mvprintw(BIG_SIZE+1, 0, "You escaped the dungeon!");
-                gameRunning = 0;
+    // The calling thread acts as worker 0, as in runBatchGeneration()
+    double start = nowSeconds();
+    int started = 0;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, validateWorkerMain, &workers[t]) != 0) break;
+        started = t;
+    }
+    threads = started + 1;
+    validateWorkerMain(&workers[0]);
+    for (int t = 1; t <= started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    double total = nowSeconds() - start;
+
+    long failures[CHECK_COUNT] = { 0 };
+    long bad = 0;
+    for (int t = 0; t < threads; t++) {
+        bad += workers[t].badLevels;
+        for (int c = 0; c < CHECK_COUNT; c++) failures[c] += workers[t].failures[c];
+    }
+
+    printf("validated %d %dx%d maps (seeds %" PRIu64 "-%" PRIu64 ") on %d thread%s in %.3f s"
+           " (%.0f maps/s)\n",
+           count, gridW, gridH, firstSeed, firstSeed + (uint64_t)count - 1,
+           threads, threads == 1 ? "" : "s", total, total > 0 ? count / total : 0.0);
+    printf("  %ld invalid (%.4f%%)\n", bad, 100.0 * bad / count);
+    for (int c = 0; c < CHECK_COUNT; c++) {
+        if (failures[c]) printf("  %-24s %ld\n", checkNames[c], failures[c]);
+    }
+
+    // The lowest failing seeds found, whichever worker met them
+    int listed = 0;
+    uint64_t after = 0;
+    while (listed < VALIDATE_EXAMPLES) {
+        int bt = -1, bi = -1;
+        for (int t = 0; t < threads; t++) {
+            for (int i = 0; i < workers[t].exampleCount; i++) {
+                uint64_t s = workers[t].examples[i];
+                if ((listed == 0 || s > after)
+                    && (bt < 0 || s < workers[bt].examples[bi])) {
+                    bt = t;
+                    bi = i;
+                }
             }
-        } else {
-            // If it's not "T" or "E", it's just a regular walkable tile.
-            // We can clear the message line.
-            mvprintw(BIG_SIZE+1, 0, "                                      ");
         }
+        if (bt < 0) break;
+        after = workers[bt].examples[bi];
+        printf("  seed %" PRIu64 ":", after);
+        for (int c = 0; c < CHECK_COUNT; c++) {
+            if (workers[bt].exampleChecks[bi] & (1u << c)) printf(" [%s]", checkNames[c]);
+        }
+        printf("\n");
+        listed++;
+    }
+    return bad ? 1 : 0;
+}
+
+/*
+ * ------------------------------------------------------------
+ * Streaming World
+ * ------------------------------------------------------------
+ *
+ * An endless map made of chunks. Each chunk is an ordinary gridW x gridH
+ * level, generated from a seed derived from the world seed and the chunk
+ * coordinate, so any chunk can be rebuilt at any time and always comes
+ * out the same. Chunks are generated when they come near the viewport and
+ * live in a fixed set of cache slots; the least recently used chunk is
+ * dropped when a new one is needed, so memory stays constant however far
+ * the player walks.
+ *
+ * Neighbouring chunks are stitched with one corridor per shared edge. The
+ * macro row (or column) the corridor crosses at is picked from a seed owned
+ * by the chunk to the west (or north) of the edge, so both chunks agree on
+ * it without either having to be loaded when the other is generated.
+ */
+
+#define WORLD_CACHE_SLOTS 64
+#define WORLD_PREFETCH_CHUNKS 1 // chunks kept ready beyond the viewport edge
+
+typedef struct {
+    int cx, cy;             // chunk coordinate
+    int valid;              // 1 once a chunk has been generated into d
+    uint64_t lastUsed;      // World.tick of the last lookup
+    Dungeon d;
+} WorldChunk;
+
+typedef struct {
+    uint64_t seed;
+    int gridW, gridH, subgridSize;
+    int chunkW, chunkH;     // tiles per chunk (bigW x bigH of each chunk)
 
-        // ---------------------------------------
-        // 3) Move the player
-        // ---------------------------------------
-        playerX = newX;
-        playerY = newY;
+    int playerX, playerY;   // player's position in world tiles
 
-        // Place the new player glyph
-        setCell(playerX, playerY, "@");
+    uint64_t tick;
+    WorldChunk *last;       // most recent lookup, checked first
+    WorldChunk slots[WORLD_CACHE_SLOTS];
+    long chunksGenerated;
+    long chunksEvicted;
+} World;
 
-        // Redraw
-        drawBigMapNcurses();
+/**
+ * mix64: splitmix64 finalizer; spreads every input bit over the output.
+ */
+static uint64_t mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * chunkSeed: Seed for chunk (cx,cy) of the world. `salt` separates the
+ * chunk's own level (0) from its east (1) and south (2) edge crossings.
+ */
+static uint64_t chunkSeed(uint64_t worldSeed, int cx, int cy, int salt)
+{
+    uint64_t key = ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+    return mix64(mix64(worldSeed + 0x9e3779b97f4a7c15ULL * (uint64_t)(salt + 1)) ^ key);
+}
+
+/**
+ * floorDiv: Integer division rounding towards negative infinity, so
+ * negative world coordinates land in the right chunk.
+ */
+static int floorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/**
+ * edgeCrossing: The macro row (east edge) or column (south edge) at which
+ * the corridor leaving chunk (cx,cy) through that edge crosses it.
+ */
+static int edgeCrossing(const World *w, int cx, int cy, int salt)
+{
+    Rng r;
+    rngSeed(&r, chunkSeed(w->seed, cx, cy, salt));
+    return rngRange(&r, salt == 1 ? w->gridH : w->gridW);
+}
+
+/**
+ * stitchEdge: Carves a corridor from macro cell (gx,gy) to the map edge on
+ * side `side` ('E', 'W', 'S' or 'N'), ending on the middle tile of that
+ * cell's span of the edge. A room gets a door on its facing wall; an
+ * empty cell gets a junction tile at its center.
+ */
+static void stitchEdge(Dungeon *d, int gx, int gy, char side)
+{
+    int sub = d->subgridSize;
+    int centerX = gx * sub + sub / 2;
+    int centerY = gy * sub + sub / 2;
+    TiledRoom *r = &TROOM(d, gx, gy);
+
+    if (!r->exists) {
+        setCell(d, centerX, centerY, TILE_CORRIDOR);
+        switch (side) {
+        case 'E': carveCorridor(d, centerX + 1, centerY, d->bigW - 1, centerY); break;
+        case 'W': carveCorridor(d, 0, centerY, centerX - 1, centerY); break;
+        case 'S': carveCorridor(d, centerX, centerY + 1, centerX, d->bigH - 1); break;
+        case 'N': carveCorridor(d, centerX, 0, centerX, centerY - 1); break;
+        }
+        return;
     }
 
-    // End curses mode
-    endwin();
+    // Rooms never touch the map edge (see keepEdgeGap), so there is always
+    // at least one tile between the door and the edge
+    if (side == 'E' || side == 'W') {
+        int doorX = (side == 'E') ? r->x + r->width - 1 : r->x;
+        int doorY = randomWallCoordinate(d, r->y, r->height);
+        TILE(d, doorX, doorY) = TILE_DOOR;
+        if (side == 'E') carveCorridor(d, doorX + 1, doorY, d->bigW - 1, centerY);
+        else             carveCorridor(d, 0, centerY, doorX - 1, doorY);
+    } else {
+        int doorX = randomWallCoordinate(d, r->x, r->width);
+        int doorY = (side == 'S') ? r->y + r->height - 1 : r->y;
+        TILE(d, doorX, doorY) = TILE_DOOR;
+        if (side == 'S') carveCorridor(d, doorX, doorY + 1, centerX, d->bigH - 1);
+        else             carveCorridor(d, centerX, 0, doorX, doorY - 1);
+    }
 }
 
-// removing rooms means that there will still be a point there
-// at which corridors can pass through, but there will be
-// no walls, floor, or doors - just corridor
-// Note: only rooms with more than 1 door will be removed
-void removeSomeRooms()
+/**
+ * generateChunk: Builds chunk (cx,cy) into `d`: a level from the chunk's
+ * own seed, without player, treasure or exit, plus one corridor out of
+ * each of its four edges.
+ */
+static void generateChunk(const World *w, Dungeon *d, int cx, int cy)
 {
-    // Remove a random number between 0 and 3 (inclusive)
-    int roomsToRemove = rand() % 4;
+    d->seed = chunkSeed(w->seed, cx, cy, 0);
+    rngSeed(&d->rng, d->seed);
+    d->stats.levels++;
 
-    while (roomsToRemove > 0)
-    {
-        for (int gy = 0; gy < SIZE; gy++)
-        {
-            for (int gx = 0; gx < SIZE; gx++)
-            {
-                // Only attempt removal if there is currently a room here.
-                if (rooms[gy][gx])
-                {
-                    // Check how many doors/corridors connect to this room
-                    int ccount = countCorridorsForCell(gx, gy);
-
-                    // Only remove if the room has 2 or more doors,
-                    // and randomly decide to remove it (like your existing code).
-                    if (ccount >= 2 && (rand() % 2 == 0))
-                    {
-                        rooms[gy][gx] = 0;
-                        roomsToRemove--;
-
-                        if (roomsToRemove == 0)
-                            break;
-                    }
-                }
+    buildTiledMap(d);
+
+    // The east and south crossings belong to this chunk; the west and
+    // north ones to the neighbours on those sides
+    stitchEdge(d, d->gridW - 1, edgeCrossing(w, cx, cy, 1), 'E');
+    stitchEdge(d, 0, edgeCrossing(w, cx - 1, cy, 1), 'W');
+    stitchEdge(d, edgeCrossing(w, cx, cy, 2), d->gridH - 1, 'S');
+    stitchEdge(d, edgeCrossing(w, cx, cy - 1, 2), 0, 'N');
+
+    runPasses(d, STAGE_TILE_PROPS, STAGE_TILE_PROPS);
+}
+
+/**
+ * worldInit: Sets up an empty world of gridW x gridH chunks, giving each
+ * cache slot an equal slice of `buffer`.
+ * @return 0 on success, -1 if the chunks do not fit.
+ */
+int worldInit(World *w, uint64_t seed, int gridW, int gridH, int subgridSize,
+              void *buffer, size_t bufferSize)
+{
+    size_t slice = (bufferSize / WORLD_CACHE_SLOTS) & ~(size_t)7;
+
+    w->seed = seed;
+    w->gridW = gridW;
+    w->gridH = gridH;
+    w->subgridSize = subgridSize;
+    for (int i = 0; i < WORLD_CACHE_SLOTS; i++) {
+        WorldChunk *c = &w->slots[i];
+        if (dungeonInit(&c->d, gridW, gridH, subgridSize,
+                        (unsigned char *)buffer + i * slice, slice) != 0) {
+            return -1;
+        }
+        c->d.keepEdgeGap = 1;
+        c->valid = 0;
+        c->lastUsed = 0;
+    }
+    w->chunkW = w->slots[0].d.bigW;
+    w->chunkH = w->slots[0].d.bigH;
+    w->tick = 0;
+    w->last = NULL;
+    w->chunksGenerated = 0;
+    w->chunksEvicted = 0;
+    return 0;
+}
+
+/**
+ * worldChunk: Returns chunk (cx,cy), generating it into the least recently
+ * used slot if it is not cached.
+ */
+static Dungeon *worldChunk(World *w, int cx, int cy)
+{
+    WorldChunk *c = w->last;
+    if (c && c->cx == cx && c->cy == cy) {
+        c->lastUsed = ++w->tick;
+        return &c->d;
+    }
+
+    WorldChunk *victim = &w->slots[0];
+    for (int i = 0; i < WORLD_CACHE_SLOTS; i++) {
+        c = &w->slots[i];
+        if (c->valid && c->cx == cx && c->cy == cy) {
+            c->lastUsed = ++w->tick;
+            w->last = c;
+            return &c->d;
+        }
+        // Empty slots have lastUsed 0 and are taken first
+        if (c->lastUsed < victim->lastUsed) victim = c;
+    }
+
+    if (victim->valid) w->chunksEvicted++;
+    generateChunk(w, &victim->d, cx, cy);
+    victim->cx = cx;
+    victim->cy = cy;
+    victim->valid = 1;
+    victim->lastUsed = ++w->tick;
+    w->chunksGenerated++;
+    w->last = victim;
+    return &victim->d;
+}
+
+/**
+ * worldTile: The tile at world position (x,y).
+ */
+static unsigned char worldTile(World *w, int x, int y)
+{
+    int cx = floorDiv(x, w->chunkW), cy = floorDiv(y, w->chunkH);
+    Dungeon *d = worldChunk(w, cx, cy);
+    return TILE(d, x - cx * w->chunkW, y - cy * w->chunkH);
+}
+
+/**
+ * worldIsWalkable: isWalkable() for world position (x,y).
+ */
+static int worldIsWalkable(World *w, int x, int y)
+{
+    int cx = floorDiv(x, w->chunkW), cy = floorDiv(y, w->chunkH);
+    Dungeon *d = worldChunk(w, cx, cy);
+    return isWalkable(d, x - cx * w->chunkW, y - cy * w->chunkH);
+}
+
+/**
+ * worldPlacePlayer: Starts the player at the center of the first room of
+ * chunk (0,0), or on its first walkable tile if every room was removed.
+ */
+static void worldPlacePlayer(World *w)
+{
+    Dungeon *d = worldChunk(w, 0, 0);
+
+    for (int i = 0; i < d->gridW * d->gridH; i++) {
+        TiledRoom *r = &d->tiledRooms[i];
+        if (r->exists) {
+            w->playerX = r->x + r->width / 2;
+            w->playerY = r->y + r->height / 2;
+            return;
+        }
+    }
+    for (int y = 0; y < d->bigH; y++) {
+        for (int x = 0; x < d->bigW; x++) {
+            if (isWalkable(d, x, y)) {
+                w->playerX = x;
+                w->playerY = y;
+                return;
             }
-            if (roomsToRemove == 0)
-                break;
         }
     }
 }
 
+/**
+ * worldPrefetch: Makes sure every chunk overlapping the viewport, plus
+ * WORLD_PREFETCH_CHUNKS beyond each side, is generated, so walking towards
+ * an edge never waits on more than the chunks that just came into range.
+ */
+static void worldPrefetch(World *w)
+{
+    int vx0 = floorDiv(viewX, w->chunkW);
+    int vy0 = floorDiv(viewY, w->chunkH);
+    int vx1 = floorDiv(viewX + viewW - 1, w->chunkW);
+    int vy1 = floorDiv(viewY + viewH - 1, w->chunkH);
+
+    // Never ask for more chunks than the cache holds at once. Give up the
+    // margins first, columns before rows, since the viewport needs the rest
+    int mx = WORLD_PREFETCH_CHUNKS, my = WORLD_PREFETCH_CHUNKS;
+    while ((vx1 - vx0 + 1 + 2 * mx) * (vy1 - vy0 + 1 + 2 * my) > WORLD_CACHE_SLOTS
+           && (mx > 0 || my > 0)) {
+        if (mx > 0) mx--;
+        else        my--;
+    }
+    int cx0 = vx0 - mx, cx1 = vx1 + mx;
+    int cy0 = vy0 - my, cy1 = vy1 + my;
+
+    // A viewport that alone needs more chunks than the cache holds: fetch
+    // the middle of it, trimming the longer side from both ends
+    while ((cx1 - cx0 + 1) * (cy1 - cy0 + 1) > WORLD_CACHE_SLOTS) {
+        if (cx1 - cx0 >= cy1 - cy0) {
+            cx0++;
+            cx1--;
+        } else {
+            cy0++;
+            cy1--;
+        }
+    }
+    for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) {
+            worldChunk(w, cx, cy);
+        }
+    }
+}
+
+/**
+ * updateWorldViewport: updateViewport() for the world: the same deadzone
+ * scrolling, but with no map edges to clamp against.
+ */
+static void updateWorldViewport(const World *w)
+{
+    int vw = COLS / 2;
+    int vh = LINES - 2;     // status line and message line below the map
+    if (vw < 1) vw = 1;
+    if (vh < 1) vh = 1;
+
+    int x = viewX, y = viewY;
+    int px = w->playerX - viewX, py = w->playerY - viewY;
+    if (vw != viewW || px < vw / 4 || px >= vw - vw / 4) x = w->playerX - vw / 2;
+    if (vh != viewH || py < vh / 4 || py >= vh - vh / 4) y = w->playerY - vh / 2;
+
+    if (x != viewX || y != viewY || vw != viewW || vh != viewH) {
+        needFullRedraw = 1;
+    }
+    viewX = x;
+    viewY = y;
+    viewW = vw;
+    viewH = vh;
+}
+
+/**
+ * drawWorldSpan: drawMapSpan() for the world: row `wy`, columns [x0, x1],
+ * with tiles fetched chunk by chunk and the player drawn on top.
+ */
+static void drawWorldSpan(World *w, int wy, int x0, int x1)
+{
+    size_t len = 0;
+    unsigned char tile = worldTile(w, x0, wy);
+
+    for (int wx = x0; wx <= x1; wx++) {
+        unsigned char nextTile = worldTile(w, wx + 1, wy);
+        if (wy == w->playerY) {
+            if (wx == w->playerX) tile = TILE_PLAYER;
+            if (wx + 1 == w->playerX) nextTile = TILE_PLAYER;
+        }
+        const RenderCell *rc = &renderTable[tile][nextTile];
+        memcpy(renderRow + len, rc->text, rc->len);
+        len += rc->len;
+        tile = nextTile;
+    }
+    renderRow[len] = '\0';
+    mvaddstr(wy - viewY, (x0 - viewX) * 2, renderRow);
+}
+
+/**
+ * drawWorldNcurses: Redraws the whole viewport, or after a plain move
+ * only the tiles around the player's old and new positions.
+ */
+static void drawWorldNcurses(World *w, int oldX, int oldY)
+{
+    updateWorldViewport(w);
+    worldPrefetch(w);
+
+    if (needFullRedraw) {
+        for (int y = 0; y < viewH; y++) {
+            drawWorldSpan(w, viewY + y, viewX, viewX + viewW - 1);
+        }
+        needFullRedraw = 0;
+    } else {
+        // The tile to the left is redrawn too; its stretch glyph depends on us
+        drawWorldSpan(w, oldY, oldX - 1 < viewX ? viewX : oldX - 1, oldX);
+        drawWorldSpan(w, w->playerY, w->playerX - 1 < viewX ? viewX : w->playerX - 1,
+                      w->playerX);
+    }
+
+    int cached = 0;
+    for (int i = 0; i < WORLD_CACHE_SLOTS; i++) cached += w->slots[i].valid;
+    mvprintw(viewH, 0, "chunk (%d,%d)  cached %d/%d  generated %ld  evicted %ld",
+             floorDiv(w->playerX, w->chunkW), floorDiv(w->playerY, w->chunkH),
+             cached, WORLD_CACHE_SLOTS, w->chunksGenerated, w->chunksEvicted);
+    clrtoeol();
+    refresh();
+}
+
+/**
+ * gameLoopWorld: gameLoopNcurses() for the streaming world. WASD moves
+ * through the world, Q quits; there is no treasure or exit to find.
+ */
+void gameLoopWorld(World *w)
+{
+    setlocale(LC_ALL, "");
+    initscr();
+    noecho();
+    cbreak();
+    keypad(stdscr, TRUE);
+    curs_set(0);
+    initRenderTable();
+
+    requestFullRedraw();
+    drawWorldNcurses(w, w->playerX, w->playerY);
+
+    while (gameRunning) {
+        int ch = getch();
+        if (ch == 'q' || ch == 'Q') {
+            gameRunning = 0;
+            break;
+        }
+
+        if (ch == KEY_RESIZE) {
+            erase();
+            requestFullRedraw();
+            drawWorldNcurses(w, w->playerX, w->playerY);
+            continue;
+        }
+
+        int newX = w->playerX;
+        int newY = w->playerY;
+
+        if (ch == 'w' || ch == 'W') newY--;
+        if (ch == 's' || ch == 'S') newY++;
+        if (ch == 'a' || ch == 'A') newX--;
+        if (ch == 'd' || ch == 'D') newX++;
+
+        if ((newX == w->playerX && newY == w->playerY) || !worldIsWalkable(w, newX, newY)) {
+            continue;
+        }
+
+        int oldX = w->playerX, oldY = w->playerY;
+        w->playerX = newX;
+        w->playerY = newY;
+        drawWorldNcurses(w, oldX, oldY);
+    }
+
+    endwin();
+}
+
 /*
  * ------------------------------------------------------------
  * main: Demonstration
  * ------------------------------------------------------------
  */
-int main(void)
+
+// Backing storage for the level; see dungeonInit()
+static unsigned char dungeonArena[DUNGEON_ARENA_BYTES];
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--grid WxH] [--subgrid N] [--seed N] [--stats FILE] [--bench]\n"
+            "          [--generate N [--out FILE] [--format F] [--threads K]]\n"
+            "          [--validate N [--threads K]]\n"
+            "          [--save FILE] [--load FILE [--index N]] [--levels N] [--monsters N]\n"
+            "          [--reveal] [--record FILE] [--replay FILE] [--world]\n"
+            "          [--bench-monsters N] [--bots N] [--passes LIST] [--list-passes]\n"
+            "  --grid WxH   macro grid size (default %dx%d, max %dx%d)\n"
+            "  --subgrid N  tiles per macro cell side (default %d, %d-%d)\n"
+            "  --seed N     generate the level from seed N (default: current time)\n"
+            "  --stats FILE write per-stage generation timings and counters as JSON\n"
+            "               to FILE (- for stdout)\n"
+            "  --passes LIST\n"
+            "               comma separated generation passes: NAME runs that pass\n"
+            "               for its stage, -NAME skips the stage (see --list-passes)\n"
+            "  --list-passes\n"
+            "               print the registered passes, * marking those that run\n"
+            "  --bench      time level generation from 3x3 to 256x256 and exit\n"
+            "  --generate N generate N levels (consecutive seeds from --seed) without\n"
+            "               ncurses and report maps/second\n"
+            "  --out FILE   with --generate, write the levels to FILE\n"
+            "  --format F   with --out: text (default); bin, a level file that\n"
+            "               --load can map directly; or rle, a level file with\n"
+            "               run-length encoded tiles (with --save too)\n"
+            "  --threads K  with --generate or --validate, use K worker threads\n"
+            "               (default: all cores)\n"
+            "  --validate N generate N levels (seeds from --seed) and check each one:\n"
+            "               entities in place and reachable, doors in walls, rooms\n"
+            "               intact; exits with status 1 if any level is invalid\n"
+            "  --save FILE  save the generated level to FILE as a level file\n"
+            "  --load FILE  play a level from a level file instead of generating one\n"
+            "  --index N    with --load, play level N of the file (default: --seed\n"
+            "               modulo the number of levels)\n"
+            "  --levels N   descend through N levels (seeds --seed, --seed+1, ...);\n"
+            "               each is built in the background while the one before\n"
+            "               it is played\n"
+            "  --monsters N put N monsters on each level; they chase the player\n"
+            "  --reveal     show the whole map instead of only what has been seen\n"
+            "  --record FILE\n"
+            "               save the game's settings and keys to FILE when it ends\n"
+            "  --replay FILE\n"
+            "               play a recorded game back without ncurses, as fast as\n"
+            "               possible, and report turns/second and the outcome\n"
+            "  --bench-monsters N\n"
+            "               time N monsters hunting the player on a 64x64 level\n"
+            "               (or the --grid given) and exit\n"
+            "  --bots N     play N games (seeds from --seed) with each scripted bot\n"
+            "               (random walk, greedy) without ncurses and report win\n"
+            "               rates and turns/second; uses --grid, --levels, --monsters\n"
+            "  --world      explore an endless world of --grid sized chunks\n",
+            prog, DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, MAX_GRID_SIZE, MAX_GRID_SIZE,
+            DEFAULT_SUBGRID_SIZE, MIN_SUBGRID_SIZE, MAX_SUBGRID_SIZE);
+}
+
+int main(int argc, char **argv)
 {
-    // 1) Generate the 3x3 "macro" dungeon layout
-    generateMaze();
-    // printMaze();
-    removeSomeRooms();
+    int gridW = DEFAULT_GRID_SIZE, gridH = DEFAULT_GRID_SIZE;
+    int gridGiven = 0;
+    int subgridSize = DEFAULT_SUBGRID_SIZE;
+    int bench = 0;
+    int world = 0;
+    int generateCount = 0;
+    const char *outPath = NULL;
+    const char *statsPath = NULL;
+    const char *savePath = NULL;
+    const char *loadPath = NULL;
+    LevelFormat format = LEVEL_FORMAT_TEXT;
+    int levelIndex = -1;
+    int levelCount = 1;
+    int benchMonsters = 0;
+    int botGames = 0;
+    int validateCount = 0;
+    const char *recordPath = NULL;
+    const char *replayPath = NULL;
+    const char *passes = NULL;
+    int listOnly = 0;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = (uint64_t)time(NULL);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &gridW, &gridH) == 1) gridH = gridW;
+            gridGiven = 1;
+        } else if (strcmp(argv[i], "--subgrid") == 0 && i + 1 < argc) {
+            subgridSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc) {
+            generateCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--validate") == 0 && i + 1 < argc) {
+            validateCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsPath = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "text") == 0) {
+                format = LEVEL_FORMAT_TEXT;
+            } else if (strcmp(argv[i], "bin") == 0) {
+                format = LEVEL_FORMAT_BINARY;
+            } else if (strcmp(argv[i], "rle") == 0) {
+                format = LEVEL_FORMAT_RLE;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            loadPath = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--bots") == 0 && i + 1 < argc) {
+            botGames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--monsters") == 0 && i + 1 < argc) {
+            monstersPerLevel = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-monsters") == 0 && i + 1 < argc) {
+            benchMonsters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--levels") == 0 && i + 1 < argc) {
+            levelCount = atoi(argv[++i]);
+            if (levelCount < 1) levelCount = 1;
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            levelIndex = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+            passes = argv[++i];
+        } else if (strcmp(argv[i], "--list-passes") == 0) {
+            listOnly = 1;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[i], "--world") == 0) {
+            world = 1;
+        } else if (strcmp(argv[i], "--reveal") == 0) {
+            fogOfWar = 0;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (configurePasses(passes) != 0) {
+        return 1;
+    }
+    if (listOnly) {
+        listPasses(stdout);
+        return 0;
+    }
+
+    if (bench) {
+        return runGenerationBenchmark(subgridSize, dungeonArena, sizeof(dungeonArena)) == 0 ? 0 : 1;
+    }
+
+    if (benchMonsters > 0) {
+        // The default 3x3 level is far too small for thousands of monsters
+        if (!gridGiven) gridW = gridH = 64;
+        return runMonsterBenchmark(gridW, gridH, subgridSize, benchMonsters, seed,
+                                   dungeonArena, sizeof(dungeonArena)) == 0 ? 0 : 1;
+    }
+
+    if (botGames > 0) {
+        return runBots(gridW, gridH, subgridSize, levelCount, botGames, seed,
+                       dungeonArena, sizeof(dungeonArena)) == 0 ? 0 : 1;
+    }
+
+    if (replayPath) {
+        return runReplay(replayPath, passes != NULL, dungeonArena, sizeof(dungeonArena)) == 0 ? 0 : 1;
+    }
+
+    if (validateCount > 0) {
+        int rc = runValidation(gridW, gridH, subgridSize, validateCount, seed, threads,
+                               dungeonArena, sizeof(dungeonArena));
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (generateCount > 0) {
+        return runBatchGeneration(gridW, gridH, subgridSize, generateCount, seed, outPath,
+                                  format, statsPath, threads, dungeonArena,
+                                  sizeof(dungeonArena)) == 0 ? 0 : 1;
+    }
+
+    if (world) {
+        static World w;
+        if (worldInit(&w, seed, gridW, gridH, subgridSize,
+                      dungeonArena, sizeof(dungeonArena)) != 0) {
+            fprintf(stderr, "Unsupported chunk size %dx%d with subgrid %d\n",
+                    gridW, gridH, subgridSize);
+            return 1;
+        }
+        worldPlacePlayer(&w);
+        gameLoopWorld(&w);
+        printf("World seed: %" PRIu64 " (%ld chunks generated)\n", seed, w.chunksGenerated);
+        return 0;
+    }
+
+    // A loaded level brings its own dimensions
+    LevelFile levelFile;
+    if (loadPath) {
+        if (recordPath) {
+            fprintf(stderr, "--record needs a generated level, not --load\n");
+            return 1;
+        }
+        if (levelFileOpen(&levelFile, loadPath) != 0) return 1;
+        gridW = levelFile.header->gridW;
+        gridH = levelFile.header->gridH;
+        subgridSize = levelFile.header->subgridSize;
+        if (levelIndex < 0) levelIndex = (int)(seed % levelFile.header->count);
+    }
 
-    // 2) Prepare and build the 30x30 "tiled" map
-    clearBigMap();
-    positionRoomsInQuadrants();
-    drawAllRooms();
-    drawMissingRoomJunctions();
-    connectNodesWithCorridors();
-    placeDoorsForCorridors();
+    // The arena holds the levels and every buffer the game needs
+    static Dungeon dungeon, spare;
+    static Pregen pregen;
+    static Game game;
+    Dungeon *d = &dungeon;
+    Dungeon *levels[2] = { &dungeon, &spare };
+    if (gameBuffersInit(levels, gridW, gridH, subgridSize, levelCount,
+                        dungeonArena, sizeof(dungeonArena)) != 0) {
+        fprintf(stderr, "Unsupported dungeon size %dx%d with subgrid %d\n",
+                gridW, gridH, subgridSize);
+        usage(argv[0]);
+        return 1;
+    }
 
-    // 3) Place player, treasure, exit
-    placePlayerInEdgeRoom();
-    placeTreasureInRandomRoom();
-    placeExitFarthestFromPlayer();
+    // 1) - 3) Build the level, or map it from the level file
+    if (loadPath) {
+        if (levelFileAttach(&levelFile, levelIndex, d) != 0) {
+            fprintf(stderr, "%s: level %d is missing or corrupt (the file has %u)\n",
+                    loadPath, levelIndex, levelFile.header->count);
+            return 1;
+        }
+    } else {
+        d->timeStages = statsPath != NULL;
+        generateLevel(d, seed);
+        if (statsPath && dumpGenStats(statsPath, &d->stats) != 0) {
+            return 1;
+        }
+    }
+    if (savePath && saveLevel(savePath, d, LEVEL_FORMAT_TILES(format)) != 0) {
+        return 1;
+    }
 
     // 4) Start ncurses main loop
-    gameLoopNcurses();
+    gameStart(&game, levels, levelCount, &pregen);
+    if (recordPath) {
+        game.keys = replayKeys;
+        game.keyCapacity = MAX_REPLAY_KEYS;
+    }
+    gameLoopNcurses(&game);
+    pregenCancel(&pregen);
+    d = game.levels[0];
+    if (recordPath && saveReplay(recordPath, &game, seed) != 0) {
+        return 1;
+    }
 
     // If you want a final message outside curses:
     if (!gameRunning) {
-        if (hasTreasure) {
+        if (playerHp <= 0) {
+            printf("You were killed by a monster on level %d.\n", currentDepth);
+        } else if (hasTreasure) {
             printf("You escaped with the treasure!\n");
         } else {
             printf("You quit or left without treasure.\n");
         }
+        printf("Dungeon seed: %" PRIu64 "\n", d->seed);
+        if (levelCount > 1) {
+            printf("Reached level %d of %d; the next level was ready in time %d of %d times\n",
+                   currentDepth, levelCount, pregen.readyCount,
+                   pregen.readyCount + pregen.syncCount);
+        }
     }
     return 0;
 }